@@ -29,6 +29,33 @@
 #include <assert.h>
 #include <math.h>
 #include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifdef IDGEN_BENCH
+// The benchmark build counts every heap allocation made by the code under
+// test, on any thread.
+static _Atomic size_t benchAllocs = 0;
+static void *countedMalloc(size_t n){
+  atomic_fetch_add_explicit(&benchAllocs, 1, memory_order_relaxed);
+  return malloc(n);
+}
+static void *countedRealloc(void *p, size_t n){
+  atomic_fetch_add_explicit(&benchAllocs, 1, memory_order_relaxed);
+  return realloc(p, n);
+}
+#define malloc(n) countedMalloc(n)
+#define realloc(p, n) countedRealloc(p, n)
+#endif
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
@@ -36,15 +63,153 @@
 #define N128 0x80
 #define Compression 1
 
+#ifdef IDGEN_STATS
+// Built with -DIDGEN_STATS (`make stats`) the code keeps counters of the
+// generator branches and allocations, a histogram of generated id lengths
+// and log-linear latency histograms. Stats are per thread; without the
+// flag every STAT_ macro compiles to nothing.
+
+#define LATENCY_SUB_BITS 4
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+typedef struct {
+  uint64_t counts[LATENCY_BUCKETS]; /**< 16 linear sub-buckets per power of two of nanoseconds. */
+  uint64_t total;
+  uint64_t max;
+} LatencyHistogram;
+
+enum { STAT_GENERATE, STAT_COMPRESS, STAT_DECOMPRESS, STAT_INSERT, STAT_DELETE, STAT_OPS };
+
+typedef struct {
+  uint64_t genEqualPrefix; /**< generateRawBetween: a is a prefix of b. */
+  uint64_t genIncrement; /**< diff == 1, last byte of a incremented. */
+  uint64_t genAppend; /**< diff == 1, prefix of b one byte long. */
+  uint64_t genAboveTail; /**< diff == 1, b ends: recurse above a's tail. */
+  uint64_t genNewDigit; /**< diff == 1, both end: new 0x40 digit. */
+  uint64_t genDivide; /**< diff > 1, midpoint byte. */
+  uint64_t genIncrementWide; /**< diff > 1 on a's last byte. */
+  uint64_t genStrategy; /**< Ids from generateRawStrategy. */
+  uint64_t genSpread; /**< Ids from generateRawSpread. */
+  uint64_t allocations; /**< idAlloc and idRealloc calls. */
+  uint64_t bytesAllocated;
+  uint64_t compressReallocs; /**< Per-run reallocs of the legacy codec. */
+  uint64_t decompressReallocs;
+  uint64_t scratchGrowths;
+  uint64_t *lengths; /**< lengths[i]: generated ids of i+1 bytes. */
+  size_t lengthsCap;
+  LatencyHistogram latency[STAT_OPS];
+} IdStatsT;
+
+static _Thread_local IdStatsT IdStats;
+
+static inline uint64_t statNow(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static inline size_t latencyBucket(uint64_t v){
+  if (v < (1u << LATENCY_SUB_BITS))
+    return v;
+  int e = 63 - __builtin_clzll(v);
+  return ((size_t)(e - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + ((v >> (e - LATENCY_SUB_BITS)) & ((1u << LATENCY_SUB_BITS) - 1));
+}
+
+static inline void recordLatency(LatencyHistogram *h, uint64_t ns){
+  h->counts[latencyBucket(ns)]++;
+  h->total++;
+  h->max = MAX(h->max, ns);
+}
+
+static void reserveLengths(size_t len){
+  if (len > IdStats.lengthsCap){
+    size_t cap = MAX(len, 2*IdStats.lengthsCap);
+    IdStats.lengths = realloc(IdStats.lengths, cap * sizeof(uint64_t));
+    memset(IdStats.lengths + IdStats.lengthsCap, 0, (cap - IdStats.lengthsCap) * sizeof(uint64_t));
+    IdStats.lengthsCap = cap;
+  }
+}
+
+static void recordLength(size_t len){
+  reserveLengths(len);
+  IdStats.lengths[len-1]++;
+}
+
+// Adds the stats a finished thread left in `from` to this thread's and
+// frees its length histogram. The counters are the leading uint64_t fields.
+static void absorbIdStats(IdStatsT *from){
+  uint64_t *dst = (uint64_t *)&IdStats, *src = (uint64_t *)from;
+  for (size_t i = 0; i < offsetof(IdStatsT, lengths) / sizeof(uint64_t); ++i)
+    dst[i] += src[i];
+  reserveLengths(from->lengthsCap);
+  for (size_t i = 0; i < from->lengthsCap; ++i)
+    IdStats.lengths[i] += from->lengths[i];
+  free(from->lengths);
+  for (int op = 0; op < STAT_OPS; ++op){
+    LatencyHistogram *h = &IdStats.latency[op], *g = &from->latency[op];
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i)
+      h->counts[i] += g->counts[i];
+    h->total += g->total;
+    h->max = MAX(h->max, g->max);
+  }
+}
+
+#define STAT_INC(name) (IdStats.name++)
+#define STAT_ADD(name, n) (IdStats.name += (n))
+#define STAT_LENGTH(len) recordLength(len)
+#define STAT_BEGIN(t) uint64_t t = statNow()
+#define STAT_END(op, t) recordLatency(&IdStats.latency[op], statNow() - (t))
+#define STAT_EXPORT(dst) ((dst) = IdStats)
+#define STAT_ABSORB(src) absorbIdStats(&(src))
+#else
+#define STAT_INC(name) ((void)0)
+#define STAT_ADD(name, n) ((void)0)
+#define STAT_LENGTH(len) ((void)0)
+#define STAT_BEGIN(t) ((void)0)
+#define STAT_END(op, t) ((void)0)
+#define STAT_EXPORT(dst) ((void)0)
+#define STAT_ABSORB(src) ((void)0)
+#endif
+
 typedef struct _ByteArray{
   size_t len; /**< Number of bytes in the `data` field. */
   uint8_t* data; /**< Pointer to an allocated array of data bytes. */
 } ByteArray;
 
+typedef struct _IdArena IdArena;
+
+#define ID_INLINE_CAP 12
+#define ID_HEAP_OFFSET 4
+
+typedef struct _InlineId {
+  uint32_t len; /**< Number of id bytes. */
+  uint8_t bytes[ID_INLINE_CAP]; /**< Id bytes when `len` <= ID_INLINE_CAP, otherwise the heap pointer at `bytes + ID_HEAP_OFFSET`. */
+} InlineId;
+
+_Static_assert(sizeof(InlineId) == 16, "InlineId must stay 16 bytes");
+
+typedef struct {
+  uint8_t *buf; /**< Reused for decoding and generating, grown on demand. */
+  size_t cap;
+} IdScratch;
+
+typedef enum {
+  STRATEGY_BISECT, /**< Midpoint of the first differing byte, the original scheme. */
+  STRATEGY_BOUNDARY_PLUS, /**< Stay within STRATEGY_BOUNDARY of the left neighbour. */
+  STRATEGY_BOUNDARY_MINUS, /**< Stay within STRATEGY_BOUNDARY of the right neighbour. */
+  STRATEGY_LSEQ, /**< Boundary+ on odd depths, boundary- on even ones. */
+  STRATEGY_EXPONENTIAL, /**< LSEQ over levels whose k-th one adds k digits. */
+  STRATEGY_APPEND /**< Exponential boundary+ at the end, boundary- at the start, bisect inside. */
+} IdStrategy;
+
 typedef struct {
-  ByteArray *ba;
+  InlineId *ba;
   size_t used;
   size_t size;
+  IdArena *arena; /**< Where ids are allocated, NULL for the C heap. */
+  IdScratch scratch; /**< Working space for id generation. */
+  IdStrategy strategy; /**< Used by GenerateIdAt, STRATEGY_BISECT by default. */
+  uint32_t site; /**< Replica suffix of generated ids, SITE_NONE by default. */
 } Array;
 
 struct node {
@@ -53,6 +218,138 @@ struct node {
 };
 typedef struct node node;
 
+int compare(ByteArray a, ByteArray b);
+int lessThan(ByteArray a, ByteArray b);
+size_t firstDifference(const uint8_t *x, const uint8_t *y, size_t n);
+
+// Ids generated at different sites end in distinct SITE_DIGITS suffixes, so
+// replicas inserting between the same neighbours never collide.
+#define SITE_DIGITS 3
+#define SITE_MAX ((1u << 20) - 1)
+#define SITE_NONE UINT32_MAX
+
+static uint8_t BottomByte = 0x01;
+static uint8_t TopByte = 0x80;
+
+///// Id allocator
+
+#define ARENA_BLOCK_SIZE 65536
+#define SLAB_CLASSES 4
+#define SLAB_MIN 8
+#define SLAB_MAX (SLAB_MIN << (SLAB_CLASSES-1))
+
+typedef struct _ArenaBlock {
+  struct _ArenaBlock *next;
+  size_t used; /**< Bytes handed out from `data`. */
+  size_t size; /**< Capacity of `data`. */
+  uint8_t data[]; /**< Bump-allocated storage. */
+} ArenaBlock;
+
+typedef struct _SlabChunk {
+  struct _SlabChunk *next;
+} SlabChunk;
+
+struct _IdArena {
+  ArenaBlock *blocks; /**< Bump blocks, most recent first. */
+  SlabChunk *slabs[SLAB_CLASSES]; /**< Free lists of recycled short ids, one per size class (8, 16, 32, 64 bytes). */
+};
+
+void initArena(IdArena *arena){
+  arena->blocks = NULL;
+  for (int i = 0; i < SLAB_CLASSES; ++i)
+    arena->slabs[i] = NULL;
+}
+
+int slabClass(size_t len){
+  int c = 0;
+  size_t cap = SLAB_MIN;
+  while (cap < len){
+    cap <<= 1;
+    c++;
+  }
+  return c;
+}
+
+void *arenaBump(IdArena *arena, size_t len){
+  len = (len + 7) & ~(size_t)7;
+  ArenaBlock *b = arena->blocks;
+  if (b == NULL || b->size - b->used < len){
+    size_t size = MAX(len, ARENA_BLOCK_SIZE);
+    b = malloc(sizeof(ArenaBlock) + size);
+    b->used = 0;
+    b->size = size;
+    b->next = arena->blocks;
+    arena->blocks = b;
+  }
+  void *p = b->data + b->used;
+  b->used += len;
+  return p;
+}
+
+// Short ids come from a size-class slab refilled by the bump allocator,
+// longer ones are bumped directly and only reclaimed with the whole arena.
+void *arenaAlloc(IdArena *arena, size_t len){
+  if (len > SLAB_MAX)
+    return arenaBump(arena, len);
+  int c = slabClass(len);
+  SlabChunk *chunk = arena->slabs[c];
+  if (chunk != NULL){
+    arena->slabs[c] = chunk->next;
+    return chunk;
+  }
+  return arenaBump(arena, SLAB_MIN << c);
+}
+
+void arenaFree(IdArena *arena, void *p, size_t len){
+  if (p == NULL || len > SLAB_MAX)
+    return;
+  int c = slabClass(len);
+  SlabChunk *chunk = p;
+  chunk->next = arena->slabs[c];
+  arena->slabs[c] = chunk;
+}
+
+void freeArena(IdArena *arena){
+  ArenaBlock *b = arena->blocks;
+  while (b != NULL){
+    ArenaBlock *next = b->next;
+    free(b);
+    b = next;
+  }
+  initArena(arena);
+}
+
+// A NULL arena falls back to the C heap.
+uint8_t *idAlloc(IdArena *arena, size_t len){
+  STAT_INC(allocations);
+  STAT_ADD(bytesAllocated, len);
+  if (arena == NULL)
+    return malloc(len);
+  return arenaAlloc(arena, len);
+}
+
+void idFree(IdArena *arena, uint8_t *p, size_t len){
+  if (arena == NULL)
+    free(p);
+  else
+    arenaFree(arena, p, len);
+}
+
+uint8_t *idRealloc(IdArena *arena, uint8_t *p, size_t oldLen, size_t newLen){
+  STAT_INC(allocations);
+  STAT_ADD(bytesAllocated, newLen);
+  if (arena == NULL)
+    return realloc(p, newLen);
+  if (newLen <= SLAB_MAX && oldLen <= SLAB_MAX && slabClass(newLen) == slabClass(oldLen))
+    return p;
+  uint8_t *q = arenaAlloc(arena, newLen);
+  memcpy(q, p, MIN(oldLen, newLen));
+  arenaFree(arena, p, oldLen);
+  return q;
+}
+
+///// end of Id allocator
+
 ///// ByteArray Functions
 
 void printByteArray(ByteArray ba){
@@ -62,16 +359,18 @@ void printByteArray(ByteArray ba){
   printf("\n");
 }
 
-ByteArray decompress(ByteArray compba){
+// The original codec, one realloc per run of 0x7f. Kept to compare
+// against in the benchmarks.
+ByteArray decompressLegacyIn(IdArena *arena, ByteArray compba){
   ByteArray ba;
   ba.len = compba.len;
-  ba.data = malloc(ba.len);
+  ba.data = idAlloc(arena, ba.len);
   int ctr, sum, k=0;
   for (int i = 0; i < compba.len; ++i){
     ctr = 0;
     sum = 0;
     if (compba.data[i] >= N128){
-      while(compba.data[i] >= N128){
+      while(i < compba.len && compba.data[i] >= N128){
         ctr++;
         if (ctr == 1)
           sum  = compba.data[i] - N128;
@@ -79,8 +378,10 @@ ByteArray decompress(ByteArray compba){
         sum = sum * N128 + compba.data[i] - N128;
         i++;
       };
+      size_t oldLen = ba.len;
       ba.len = ba.len - ctr + sum;
-      ba.data = realloc(ba.data, ba.len);
+      ba.data = idRealloc(arena, ba.data, oldLen, ba.len);
+      STAT_INC(decompressReallocs);
       for (int j = k; j < k+sum; ++j)
         ba.data[j] = N127;
       k = k + sum;
@@ -94,11 +395,15 @@ ByteArray decompress(ByteArray compba){
   return ba;
 }
 
+ByteArray decompressLegacy(ByteArray compba){
+  return decompressLegacyIn(NULL, compba);
+}
+
 int isTopVal(ByteArray ba){
   return (ba.len == 1 && ba.data[0]==N128);
 }
 
-int getNumberOfSevenBits(int num){
+int getNumberOfSevenBits(size_t num){
   int count = 0;
   while (num > 0){
     count++;
@@ -107,22 +412,24 @@ int getNumberOfSevenBits(int num){
   return count;
 }
 
-ByteArray compress(ByteArray ba){
+ByteArray compressLegacyIn(IdArena *arena, ByteArray ba){
   ByteArray compba;
   compba.len = ba.len;
-  compba.data = malloc(compba.len);
+  compba.data = idAlloc(arena, compba.len);
   int ctr, sum, k=0;
   for (int i = 0; i < ba.len; ++i){
     ctr = 0;
     sum = 0;
     if (ba.data[i] == N127){
-      while(ba.data[i] == N127){
+      while(i < ba.len && ba.data[i] == N127){
         ctr++;
         i++;
       };
       sum = getNumberOfSevenBits(ctr);
+      size_t oldLen = compba.len;
       compba.len = compba.len - ctr + sum;
-      compba.data = realloc(compba.data, compba.len);
+      compba.data = idRealloc(arena, compba.data, oldLen, compba.len);
+      STAT_INC(compressReallocs);
       for (int j = k; j < k+sum-1; ++j)
         compba.data[j] = ctr/N128 + N128;
       compba.data[k+sum-1] = ctr % N128 + N128;
@@ -137,6 +444,10 @@ ByteArray compress(ByteArray ba){
   return compba;
 }
 
+ByteArray compressLegacy(ByteArray ba){
+  return compressLegacyIn(NULL, ba);
+}
+
 int is_full(ByteArray ba, int start){
   for (int i = start; i < ba.len-1; ++i)
     if (ba.data[i] != N127)
@@ -144,18 +455,18 @@ int is_full(ByteArray ba, int start){
   return 1;
 }
 
-ByteArray incrementByteArray(ByteArray ba){
+ByteArray incrementByteArrayIn(IdArena *arena, ByteArray ba){
   ByteArray newba;
   if (ba.data[ba.len-1] == N127){
     newba.len = ba.len+1;
-    newba.data = malloc(newba.len);
+    newba.data = idAlloc(arena, newba.len);
     for (int i = 0; i < ba.len; ++i)
       newba.data[i] = ba.data[i];
     newba.data[newba.len-1] = 0x01;
   }
   else{
     newba.len = ba.len; 
-    newba.data = malloc(newba.len);
+    newba.data = idAlloc(arena, newba.len);
     for (int i = 0; i < ba.len; ++i)
       newba.data[i] = ba.data[i];
     newba.data[newba.len-1]++;
@@ -163,220 +474,3919 @@ ByteArray incrementByteArray(ByteArray ba){
   return newba;
 }
 
-ByteArray ByteArray_GenerateBetween(ByteArray ba1, ByteArray ba2, int withCompression){
-  if(withCompression){
-    if (!isTopVal(ba1))
-      ba1 = decompress(ba1);
-    if (!isTopVal(ba2))
-      ba2 = decompress(ba2);
+ByteArray incrementByteArray(ByteArray ba){
+  return incrementByteArrayIn(NULL, ba);
+}
+
+// Offset of the first byte >= 0x80 (a run count) in data, eight bytes at
+// a time, or len.
+size_t nextRunCount(const uint8_t *data, size_t len){
+  size_t i = 0;
+  for (; i+8 <= len; i += 8){
+    uint64_t w;
+    memcpy(&w, data+i, 8);
+    w &= 0x8080808080808080ull;
+    if (w != 0){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      return i + __builtin_ctzll(w) / 8;
+#else
+      return i + __builtin_clzll(w) / 8;
+#endif
+    }
   }
-  assert(lessThan(ba1, ba2));
-  ByteArray res;
+  while (i < len && data[i] < N128)
+    i++;
+  return i;
+}
+
+// Length of the run of 0x7f starting at data, eight bytes at a time.
+size_t runOf127(const uint8_t *data, size_t len){
+  size_t i = 0;
+  for (; i+8 <= len; i += 8){
+    uint64_t w;
+    memcpy(&w, data+i, 8);
+    w ^= 0x7f7f7f7f7f7f7f7full;
+    if (w != 0){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      return i + __builtin_ctzll(w) / 8;
+#else
+      return i + __builtin_clzll(w) / 8;
+#endif
+    }
+  }
+  while (i < len && data[i] == N127)
+    i++;
+  return i;
+}
+
+// The exact codec below skips from run to run and copies the bytes in
+// between in one go. Short ids, the common case, are cheaper byte by byte.
+#define CODEC_SHORT 16
+
+// Exact number of bytes decompress would produce, without producing them.
+size_t decompressedLen(ByteArray compba){
+  size_t len = 0, i = 0;
+  while (i < compba.len){
+    if (compba.data[i] < N128){
+      size_t plain = compba.len <= CODEC_SHORT ? 1 : nextRunCount(compba.data+i, compba.len-i);
+      len += plain;
+      i += plain;
+      continue;
+    }
+    size_t sum = 0;
+    while(i < compba.len && compba.data[i] >= N128)
+      sum = sum * N128 + compba.data[i++] - N128;
+    len += sum;
+  }
+  return len;
+}
+
+size_t decompressInto(ByteArray compba, uint8_t *out){
+  size_t k = 0, i = 0;
+  while (i < compba.len){
+    if (compba.data[i] < N128){
+      if (compba.len <= CODEC_SHORT){
+        out[k++] = compba.data[i++];
+        continue;
+      }
+      size_t plain = nextRunCount(compba.data+i, compba.len-i);
+      memcpy(out+k, compba.data+i, plain);
+      k += plain;
+      i += plain;
+      continue;
+    }
+    size_t sum = 0;
+    while(i < compba.len && compba.data[i] >= N128)
+      sum = sum * N128 + compba.data[i++] - N128;
+    memset(out+k, N127, sum);
+    k += sum;
+  }
+  return k;
+}
+
+// Bytes before the next 0x7f, at least one.
+size_t plainBefore127(const uint8_t *data, size_t len){
+  const uint8_t *run = memchr(data, N127, len);
+  return run == NULL ? len : (size_t)(run - data);
+}
+
+// Exact number of bytes compress would produce.
+size_t compressedLen(const uint8_t *data, size_t len){
+  size_t clen = 0, i = 0;
+  while (i < len){
+    if (data[i] != N127){
+      size_t plain = len <= CODEC_SHORT ? 1 : plainBefore127(data+i, len-i);
+      clen += plain;
+      i += plain;
+      continue;
+    }
+    size_t ctr = runOf127(data+i, len-i);
+    clen += getNumberOfSevenBits(ctr);
+    i += ctr;
+  }
+  return clen;
+}
+
+// Runs of 0x7f become their count in big-endian base 128, each digit
+// tagged with the high bit.
+size_t compressInto(const uint8_t *data, size_t len, uint8_t *out){
+  size_t k = 0, i = 0;
+  while (i < len){
+    if (data[i] != N127){
+      if (len <= CODEC_SHORT){
+        out[k++] = data[i++];
+        continue;
+      }
+      size_t plain = plainBefore127(data+i, len-i);
+      memcpy(out+k, data+i, plain);
+      k += plain;
+      i += plain;
+      continue;
+    }
+    size_t ctr = runOf127(data+i, len-i);
+    i += ctr;
+    int sum = getNumberOfSevenBits(ctr);
+    for (int j = sum-1; j >= 0; --j){
+      out[k+j] = ctr % N128 + N128;
+      ctr /= N128;
+    }
+    k += sum;
+  }
+  return k;
+}
+
+// Sizes are computed exactly first, so both directions make a single
+// allocation. The compressed form is never longer than the raw one, so
+// short ids are encoded on the stack instead and copied out.
+ByteArray decompressIn(IdArena *arena, ByteArray compba){
+  STAT_BEGIN(t);
+  ByteArray ba;
+  if (compba.len <= CODEC_SHORT && nextRunCount(compba.data, compba.len) == compba.len){
+    ba.len = compba.len;
+    ba.data = idAlloc(arena, ba.len);
+    memcpy(ba.data, compba.data, ba.len);
+    STAT_END(STAT_DECOMPRESS, t);
+    return ba;
+  }
+  ba.len = decompressedLen(compba);
+  ba.data = idAlloc(arena, ba.len);
+  decompressInto(compba, ba.data);
+  STAT_END(STAT_DECOMPRESS, t);
+  return ba;
+}
+
+ByteArray decompress(ByteArray compba){
+  return decompressIn(NULL, compba);
+}
+
+ByteArray compressIn(IdArena *arena, ByteArray ba){
+  STAT_BEGIN(t);
+  ByteArray compba;
+  if (ba.len <= CODEC_SHORT){
+    uint8_t buf[CODEC_SHORT];
+    compba.len = compressInto(ba.data, ba.len, buf);
+    compba.data = idAlloc(arena, compba.len);
+    memcpy(compba.data, buf, compba.len);
+    STAT_END(STAT_COMPRESS, t);
+    return compba;
+  }
+  compba.len = compressedLen(ba.data, ba.len);
+  compba.data = idAlloc(arena, compba.len);
+  compressInto(ba.data, ba.len, compba.data);
+  STAT_END(STAT_COMPRESS, t);
+  return compba;
+}
 
-  for (int i = 0; i < ba1.len; ++i){
-    uint8_t diff = ba2.data[i] - ba1.data[i];
+ByteArray compress(ByteArray ba){
+  return compressIn(NULL, ba);
+}
+
+int isFullRaw(const uint8_t *a, size_t al, size_t start){
+  for (size_t i = start; i+1 < al; ++i)
+    if (a[i] != N127)
+      return 0;
+  return 1;
+}
+
+// Core of the generation on decompressed bytes. `out` must hold al+bl+2
+// bytes; returns the length written.
+size_t generateRawBetween(const uint8_t *a, size_t al, const uint8_t *b, size_t bl, uint8_t *out){
+  for (size_t i = 0; i < al; ++i){
+    uint8_t diff = b[i] - a[i];
     if (diff == 0){
-      if (ba1.len > i+1)
+      if (al > i+1)
         continue;
-      else{
-        if (ba2.data[i+1] == 0x01){
-          res.len = i+3;
-          res.data = malloc(res.len);
-          for (int j = 0; j <= i; ++j)
-            res.data[j] = ba2.data[j];
-          res.data[i+1] = 0x00;
-          res.data[i+2] = 0x40;
-        }
-        else{
-          res.len = i+2;
-          res.data = malloc(res.len);
-          for (int j = 0; j <= i; ++j)
-            res.data[j] = ba2.data[j];
-          res.data[i+1] = (ba2.data[i+1]+1)/2;
-        }
-        break;
+      // a is a prefix of b: go below b, stepping over its zero bytes
+      STAT_INC(genEqualPrefix);
+      size_t j = i+1;
+      while (j+1 < bl && b[j] == 0x00)
+        j++;
+      memcpy(out, b, j);
+      if (b[j] <= 0x01){
+        out[j] = 0x00;
+        out[j+1] = 0x40;
+        return j+2;
       }
+      out[j] = (b[j]+1)/2;
+      return j+1;
     }
     else if (diff == 1){
-      if ((ba2.len-i>1 && ba1.len-i==1) || (ba2.len-i==1 && ba1.len-i >1 && is_full(ba1, i+1))){
+      if ((bl-i>1 && al-i==1) || (bl-i==1 && al-i>1 && isFullRaw(a, al, i+1))){
         //increment
-        res = incrementByteArray(ba1);
+        STAT_INC(genIncrement);
+        memcpy(out, a, al);
+        if (a[al-1] == N127){
+          out[al] = 0x01;
+          return al+1;
+        }
+        out[al-1]++;
+        return al;
       }
-      else{
+      else if (bl-i>1){
         // append
-        if (ba2.len-i>1){
-          res.len = i+1;
-          res.data = malloc(res.len);
-          for (int j = 0; j <= i; ++j)
-            res.data[j] = ba2.data[j]; 
-        }
-        else{
-          res.len = i+2;
-          res.data = malloc(res.len);
-          for (int j = 0; j <= i; ++j)
-            res.data[j] = ba1.data[j];
-          res.data[i+1] = 0x40;
-        }
+        STAT_INC(genAppend);
+        memcpy(out, b, i+1);
+        return i+1;
+      }
+      else if (al-i>1){
+        // b ends here: anything above the rest of a will do
+        STAT_INC(genAboveTail);
+        memcpy(out, a, i+1);
+        return i+1 + generateRawBetween(a+i+1, al-i-1, &TopByte, 1, out+i+1);
+      }
+      else{
+        STAT_INC(genNewDigit);
+        memcpy(out, a, i+1);
+        out[i+1] = 0x40;
+        return i+2;
       }
-      break;
     }
     else{ 
       //new tab size is always 1
-      if (ba1.len - i > 1){
+      memcpy(out, a, al);
+      if (al - i > 1){
         //divide
-        res.len = i+1;
-        res.data = malloc(res.len);
-        for (int j = 0; j < i; ++j)
-          res.data[j] = ba1.data[j];
-        // res.data[i] = (uint8_t)ceil((double)(ba2.data[i]+ba1.data[i])/2);
-        res.data[i] = (ba2.data[i]+ba1.data[i]+1)/2;
-      }
-      else{
-        //increment
-        res = incrementByteArray(ba1);
+        STAT_INC(genDivide);
+        out[i] = (b[i]+a[i]+1)/2;
+        return i+1;
       }
-      break;
+      //increment
+      STAT_INC(genIncrementWide);
+      out[al-1]++;
+      return al;
     }
   }
-  assert(lessThan(ba1, res));
-  assert(lessThan(res, ba2));
-  if(withCompression)
-    res = compress(res);
-  return res;
+  return 0;
 }
 
-int compare(ByteArray a, ByteArray b)
-{
-  for (int i = 0; i < MIN(a.len, b.len); ++i)
-    if(a.data[i] < b.data[i])
-      return -1;
-    else if(a.data[i] > b.data[i])
+// Ids read as base-128 fractions, digit by digit, for the generators that
+// pick a depth and do arithmetic on it.
+
+// Loads x as a D-digit number into out[1..D], out[0] being headroom for
+// the top sentinel's 0x80. Returns whether x had non-zero digits past D.
+int loadDigits(const uint8_t *x, size_t xl, size_t D, uint8_t *out){
+  out[0] = 0;
+  for (size_t i = 0; i < D; ++i)
+    out[i+1] = i < xl ? x[i] : 0;
+  for (size_t i = D; i < xl; ++i)
+    if (x[i] != 0)
       return 1;
-    else
-      continue;
-  if(a.len<b.len)
-    return -1;
-  else
-    return 0;
+  return 0;
 }
 
-int lessThan(ByteArray a, ByteArray b){
-  return compare(a, b) == -1;
+void normalizeDigits(uint8_t *x, size_t L){
+  for (size_t i = L-1; i > 0; --i)
+    if (x[i] >= N128){
+      x[i] -= N128;
+      x[i-1]++;
+    }
 }
 
-int greaterThan(ByteArray a, ByteArray b){
-  return compare(a, b) == 1;
+void addDigits(uint8_t *x, const uint8_t *y, size_t L){
+  int carry = 0;
+  for (size_t i = L; i-- > 0;){
+    int d = x[i] + y[i] + carry;
+    x[i] = d % N128;
+    carry = d / N128;
+  }
 }
 
-int equalsTo(ByteArray a, ByteArray b){
-  return compare(a, b) == 0;
+// x = hi - lo, hi >= lo
+void subDigits(const uint8_t *hi, const uint8_t *lo, uint8_t *x, size_t L){
+  int borrow = 0;
+  for (size_t i = L; i-- > 0;){
+    int d = hi[i] - lo[i] - borrow;
+    borrow = d < 0;
+    x[i] = borrow ? d + N128 : d;
+  }
 }
 
-///// end of ByteArray
+uint64_t digitsToU64(const uint8_t *x, size_t L){
+  uint64_t v = 0;
+  for (size_t i = 0; i < L; ++i){
+    if (v > (UINT64_MAX >> 7))
+      return UINT64_MAX;
+    v = v * N128 + x[i];
+  }
+  return v;
+}
 
-///// Sequence imlpemented as growable array
+void divDigits(uint8_t *x, size_t L, uint64_t divisor){
+  uint64_t rem = 0;
+  for (size_t i = 0; i < L; ++i){
+    uint64_t cur = rem * N128 + x[i];
+    x[i] = cur / divisor;
+    rem = cur % divisor;
+  }
+}
 
-void initArray(Array *a, size_t initialSize) {
-  a->ba = malloc(initialSize * sizeof(ByteArray));
-  a->used = 0;
-  a->size = initialSize;
+#define STRATEGY_BOUNDARY 16
+
+// Exponential depths are the triangular numbers: the k-th level adds k
+// digits, so its base is 128^k (the byte analogue of LSEQ's base
+// doubling) and a run of appends grows ids in O(sqrt(log n)) levels.
+// Returns the level of D, or 0 if D is not a level boundary.
+size_t depthLevel(size_t D){
+  size_t t = 0, k = 0;
+  while (t < D)
+    t += ++k;
+  return t == D ? k : 0;
 }
 
-ByteArray GenerateIdAt(Array *a, int pos) {
-  ByteArray bal, bar;
-  bal.len = 1;
-  bal.data = malloc(bal.len);
-  bal.data[0] = 0x01;
-  bar.len = 1;
-  bar.data = malloc(bar.len);
-  bar.data[0] = 0x80;
-  if (a->used == 0) // empty Array
-    return ByteArray_GenerateBetween(bal, bar, Compression);
-  else // not empty Array
-    if (pos == 0) // insert in the begining
-      return ByteArray_GenerateBetween(bal, a->ba[pos], Compression);
-    else if (pos == a->used) // insert in the end
-      return ByteArray_GenerateBetween(a->ba[pos-1], bar, Compression);
-    else
-      return ByteArray_GenerateBetween(a->ba[pos-1], a->ba[pos], Compression);
+// Work space needed by generateRawStrategy.
+size_t strategyWorkLen(size_t al, size_t bl){
+  return 3 * (2*MAX(al, bl) + 16);
 }
 
-void insertArrayAt(Array *a, int pos) {
-  // a->used is the number of used entries, because a->ba[a->used++] updates a->used only *after* the array has been accessed.
-  // Therefore a->used can go up to a->size 
-  if (pos <= a->used+1) {
-    if (a->used == a->size) {
-      a->size *= 2;
-      a->ba = realloc(a->ba, a->size * sizeof(ByteArray));
-    }
-    // shift values right
-    if (a->used > 0 || pos < a->used)
-      for (int i = a->used-1; i >= pos; --i)
-        a->ba[i+1] = a->ba[i];
-    ByteArray element = GenerateIdAt(a, pos);
-    a->ba[pos] = element;
-    ++a->used;
+// Generates one decompressed id strictly between a and b at the shallowest
+// allowed depth with room, placed next to a (plus) or b (minus).
+size_t generateRawStrategy(const uint8_t *a, size_t al, const uint8_t *b, size_t bl, IdStrategy strategy, uint8_t *work, uint8_t *out){
+  STAT_INC(genStrategy);
+  int exponential = strategy == STRATEGY_EXPONENTIAL || strategy == STRATEGY_APPEND;
+  size_t lastNonZero = bl;
+  while (lastNonZero > 0 && b[lastNonZero-1] == 0)
+    lastNonZero--;
+  // gap = trunc(b) - trunc(a) at depth D, plus one while b has digits past
+  // D; it only needs to be exact below 2
+  size_t p = firstDifference(a, b, MIN(al, bl));
+  int64_t gap = 0;
+  size_t D = p;
+  for (;;){
+    gap = gap * N128 + (D < bl ? b[D] : 0) - (D < al ? a[D] : 0);
+    D++;
+    if (gap + (lastNonZero > D) >= 2 && (!exponential || depthLevel(D) > 0))
+      break;
+    gap = MIN(gap, 2);
   }
+  size_t L = D+1;
+  uint8_t *lo = work, *hi = lo + L, *step = hi + L;
+  loadDigits(a, al, D, lo);
+  if (loadDigits(b, bl, D, hi)){
+    memset(step, 0, L);
+    step[L-1] = 1;
+    addDigits(hi, step, L);
+  }
+  normalizeDigits(hi, L);
+  subDigits(hi, lo, step, L);
+
+  int plus = strategy != STRATEGY_BOUNDARY_MINUS;
+  if (strategy == STRATEGY_LSEQ)
+    plus = D % 2;
+  else if (strategy == STRATEGY_EXPONENTIAL)
+    plus = depthLevel(D) % 2;
+  else if (strategy == STRATEGY_APPEND)
+    plus = !(al == 1 && a[0] == BottomByte) || (bl == 1 && b[0] == TopByte);
+  uint64_t n = MIN(STRATEGY_BOUNDARY, digitsToU64(step, L) - 1);
+  memset(step, 0, L);
+  step[L-1] = n;
+  if (plus)
+    addDigits(lo, step, L);
   else
-    printf("Position is out of bounds\n");
+    subDigits(hi, step, lo, L);
+  size_t len = D;
+  while (len > 0 && lo[len] == 0)
+    len--;
+  memcpy(out, lo+1, len);
+  return len;
 }
 
-void printArray(Array *a) {
-  for (int i = 0; i < a->used; ++i)
-    printByteArray(a->ba[i]);
+void initScratch(IdScratch *scratch){
+  scratch->buf = NULL;
+  scratch->cap = 0;
 }
 
-void deleteArrayAt(Array *a, int pos) {
-  if (pos <= a->used) {
-    // shift values left
-    for (int i = pos; i < a->size-1; ++i)
-      a->ba[i] = a->ba[i+1];
-    --a->size;
-    --a->used;
-    a->ba = realloc(a->ba, a->size * sizeof(ByteArray));
+uint8_t *scratchReserve(IdScratch *scratch, size_t len){
+  if (scratch->cap < len){
+    STAT_INC(scratchGrowths);
+    scratch->cap = MAX(len, 2*scratch->cap);
+    scratch->buf = realloc(scratch->buf, scratch->cap);
   }
-  else
-    printf("Position is out of bounds\n");
+  return scratch->buf;
 }
 
-void freeArray(Array *a) {
-  free(a->ba);
-  a->ba = NULL;
-  a->used = a->size = 0;
+void freeScratch(IdScratch *scratch){
+  free(scratch->buf);
+  initScratch(scratch);
 }
 
-void printArrayBytes(Array *a){
-  int size = 10;
-  int b[size];
-  for (int i = 0; i < size; ++i)
-    b[i] = 0;
-  for (int i = 0; i < a->used; ++i)
-    b[a->ba[i].len-1]++;
-  for (int i = 0; i < size; ++i)
-    printf("ids of size %d Byte(s): %d\n", i+1, b[i]);
+// 20 bits of site over three digits, the last one odd so that the id never
+// ends in 0x00.
+void putSiteDigits(uint32_t site, uint8_t *out){
+  out[0] = (site >> 13) & N127;
+  out[1] = (site >> 6) & N127;
+  out[2] = ((site & 0x3f) << 1) | 1;
 }
 
-void randomInsertTest(int max){
-  Array a;
-  initArray(&a, max);
-  while(max > 0){
-    int pos = rand() % (a.used+1);
-    int k = MAX(rand() % max, 1);
-    // int k = 1;
-    printf("pos is: %d\n", pos);
-    printf("k is: %d\n", k);
-    for (int i = 0; i < MIN(k, max); ++i)
-      insertArrayAt(&a, pos+i);
-    max = max-k;
-  };
-  printArray(&a);
-  printArrayBytes(&a);
-  freeArray(&a);
+uint32_t getSiteDigits(const uint8_t *in){
+  return ((uint32_t)in[0] << 13) | ((uint32_t)in[1] << 6) | (in[2] >> 1);
 }
 
-///// end of Seq as Growable Array
+// Decodes both neighbours, generates and re-encodes entirely inside the
+// scratch buffer. The returned bytes belong to the scratch and are only
+// valid until its next use. Unless `site` is SITE_NONE the id ends with
+// the site's suffix.
+ByteArray ByteArray_GenerateBetweenSite(IdScratch *scratch, ByteArray ba1, ByteArray ba2, IdStrategy strategy, uint32_t site, int withCompression){
+  STAT_BEGIN(t);
+  size_t al = ba1.len, bl = ba2.len;
+  if (withCompression){
+    if (!isTopVal(ba1))
+      al = decompressedLen(ba1);
+    if (!isTopVal(ba2))
+      bl = decompressedLen(ba2);
+  }
+  size_t rawCap = MAX(al+bl+2, strategyWorkLen(al, bl));
+  if (site != SITE_NONE) // room for a regenerated prefix and the suffix
+    rawCap += al+2+SITE_DIGITS;
+  uint8_t *buf = scratchReserve(scratch, al+bl+2*rawCap+strategyWorkLen(al, bl));
+  ByteArray raw1 = {al, buf}, raw2 = {bl, buf+al};
+  if (withCompression && !isTopVal(ba1))
+    decompressInto(ba1, raw1.data);
+  else
+    memcpy(raw1.data, ba1.data, al);
+  if (withCompression && !isTopVal(ba2))
+    decompressInto(ba2, raw2.data);
+  else
+    memcpy(raw2.data, ba2.data, bl);
+  assert(lessThan(raw1, raw2));
 
-///// unit tests
+  ByteArray res;
+  res.data = buf+al+bl;
+  // append-biased only changes the ends, interior inserts bisect as before
+  if (strategy == STRATEGY_BISECT || (strategy == STRATEGY_APPEND && !isTopVal(ba2) && !(al == 1 && raw1.data[0] == BottomByte)))
+    res.len = generateRawBetween(raw1.data, al, raw2.data, bl, res.data);
+  else
+    res.len = generateRawStrategy(raw1.data, al, raw2.data, bl, strategy, res.data + 2*rawCap, res.data);
+  if (site != SITE_NONE){
+    assert(site <= SITE_MAX);
+    // a suffix keeps the id above raw1, but it overshoots raw2 when the id
+    // is a prefix of it; ids closer to raw1 get shorter until one is not
+    while (res.len <= bl && memcmp(res.data, raw2.data, res.len) == 0){
+      uint8_t *tmp = res.data + rawCap;
+      size_t len = generateRawBetween(raw1.data, al, res.data, res.len, tmp);
+      memcpy(res.data, tmp, len);
+      res.len = len;
+    }
+    putSiteDigits(site, res.data + res.len);
+    res.len += SITE_DIGITS;
+  }
+  assert(lessThan(raw1, res));
+  assert(lessThan(res, raw2));
+  if (withCompression){
+    uint8_t *compbuf = res.data + rawCap;
+    res.len = compressInto(res.data, res.len, compbuf);
+    res.data = compbuf;
+  }
+  STAT_LENGTH(res.len);
+  STAT_END(STAT_GENERATE, t);
+  return res;
+}
+
+ByteArray ByteArray_GenerateBetweenWith(IdScratch *scratch, ByteArray ba1, ByteArray ba2, IdStrategy strategy, int withCompression){
+  return ByteArray_GenerateBetweenSite(scratch, ba1, ba2, strategy, SITE_NONE, withCompression);
+}
+
+ByteArray ByteArray_GenerateBetweenView(IdScratch *scratch, ByteArray ba1, ByteArray ba2, int withCompression){
+  return ByteArray_GenerateBetweenWith(scratch, ba1, ba2, STRATEGY_BISECT, withCompression);
+}
+
+// Same as ByteArray_GenerateBetweenIn with intermediates kept in the
+// caller's scratch, so the result is the only allocation.
+ByteArray ByteArray_GenerateBetweenScratch(IdArena *arena, IdScratch *scratch, ByteArray ba1, ByteArray ba2, int withCompression){
+  ByteArray view = ByteArray_GenerateBetweenView(scratch, ba1, ba2, withCompression);
+  ByteArray res;
+  res.len = view.len;
+  res.data = idAlloc(arena, res.len);
+  memcpy(res.data, view.data, res.len);
+  return res;
+}
+
+ByteArray ByteArray_GenerateBetweenIn(IdArena *arena, ByteArray ba1, ByteArray ba2, int withCompression){
+  IdScratch scratch;
+  initScratch(&scratch);
+  ByteArray res = ByteArray_GenerateBetweenScratch(arena, &scratch, ba1, ba2, withCompression);
+  freeScratch(&scratch);
+  return res;
+}
+
+ByteArray ByteArray_GenerateBetween(ByteArray ba1, ByteArray ba2, int withCompression){
+  return ByteArray_GenerateBetweenIn(NULL, ba1, ba2, withCompression);
+}
+
+// Bulk generation treats ids as base-128 fractions: at the shortest depth
+// D where (left, right) holds at least n+1 D-digit values, the gap is cut
+// into n+1 equal steps. Ids then grow with log128(n) instead of n.
+
+// Work space needed by generateRawSpread.
+size_t spreadWorkLen(size_t al, size_t bl){
+  return 4 * (MAX(al, bl) + 12);
+}
+
+// Plans n evenly spaced ids strictly between a and b: the k-th (from 1)
+// is lo + k*step in D+1 base-128 digits, lo and step being written to
+// work. Returns D.
+size_t planRawSpread(const uint8_t *a, size_t al, const uint8_t *b, size_t bl, size_t n, uint8_t *work){
+  assert(n < ((uint64_t)1 << 56));
+  size_t D = firstDifference(a, b, MIN(al, bl)) + 1;
+  uint8_t *lo, *hi, *step;
+  size_t L;
+  for (;; ++D){
+    L = D+1;
+    lo = work;
+    hi = lo + L;
+    step = hi + L;
+    loadDigits(a, al, D, lo);
+    if (loadDigits(b, bl, D, hi)){
+      memset(step, 0, L);
+      step[L-1] = 1;
+      addDigits(hi, step, L);
+    }
+    normalizeDigits(hi, L);
+    subDigits(hi, lo, step, L);
+    if (digitsToU64(step, L) > n)
+      break;
+  }
+  divDigits(step, L, n+1);
+  return D;
+}
+
+// x *= m, m < 2^56
+void mulDigits(uint8_t *x, size_t L, uint64_t m){
+  uint64_t carry = 0;
+  for (size_t i = L; i-- > 0;){
+    uint64_t cur = x[i] * m + carry;
+    x[i] = cur % N128;
+    carry = cur / N128;
+  }
+}
+
+// Emits ids from+1 to `to` of a planned spread, in order, building them
+// in v (D+1 bytes). Slices can be emitted independently of each other.
+void emitSpreadRange(const uint8_t *plan, size_t D, size_t from, size_t to, uint8_t *v, void (*emit)(const uint8_t *raw, size_t len, void *ctx), void *ctx){
+  size_t L = D+1;
+  const uint8_t *lo = plan, *step = plan + 2*L;
+  memcpy(v, step, L);
+  mulDigits(v, L, from);
+  addDigits(v, lo, L);
+  for (size_t k = from; k < to; ++k){
+    addDigits(v, step, L);
+    size_t len = D;
+    while (len > 0 && v[len] == 0)
+      len--;
+    STAT_INC(genSpread);
+    emit(v+1, len, ctx);
+  }
+}
+
+// Emits n increasing decompressed ids strictly between a and b.
+void generateRawSpread(const uint8_t *a, size_t al, const uint8_t *b, size_t bl, size_t n, uint8_t *work, void (*emit)(const uint8_t *raw, size_t len, void *ctx), void *ctx){
+  size_t D = planRawSpread(a, al, b, bl, n, work);
+  emitSpreadRange(work, D, 0, n, work + 3*(D+1), emit, ctx);
+}
+
+typedef struct {
+  ByteArray *out;
+  size_t k;
+  int withCompression;
+} SpreadCollect;
+
+void collectSpread(const uint8_t *raw, size_t len, void *ctx){
+  SpreadCollect *c = ctx;
+  ByteArray *res = &c->out[c->k++];
+  res->len = c->withCompression ? compressedLen(raw, len) : len;
+  res->data = malloc(res->len);
+  if (c->withCompression)
+    compressInto(raw, len, res->data);
+  else
+    memcpy(res->data, raw, len);
+}
+
+// Decodes both neighbours into scratch and plans n ids between them,
+// returning the plan for emitSpreadRange and its digit count in *D.
+uint8_t *planSpreadBetween(IdScratch *scratch, ByteArray ba1, ByteArray ba2, size_t n, int withCompression, size_t *D){
+  size_t al = ba1.len, bl = ba2.len;
+  if (withCompression){
+    if (!isTopVal(ba1))
+      al = decompressedLen(ba1);
+    if (!isTopVal(ba2))
+      bl = decompressedLen(ba2);
+  }
+  uint8_t *buf = scratchReserve(scratch, al + bl + spreadWorkLen(al, bl));
+  if (withCompression && !isTopVal(ba1))
+    decompressInto(ba1, buf);
+  else
+    memcpy(buf, ba1.data, al);
+  if (withCompression && !isTopVal(ba2))
+    decompressInto(ba2, buf+al);
+  else
+    memcpy(buf+al, ba2.data, bl);
+  *D = planRawSpread(buf, al, buf+al, bl, n, buf+al+bl);
+  return buf+al+bl;
+}
+
+// Decodes both neighbours into scratch and spreads n ids between them.
+void spreadBetween(IdScratch *scratch, ByteArray ba1, ByteArray ba2, size_t n, int withCompression, void (*emit)(const uint8_t *raw, size_t len, void *ctx), void *ctx){
+  size_t D;
+  uint8_t *plan = planSpreadBetween(scratch, ba1, ba2, n, withCompression, &D);
+  emitSpreadRange(plan, D, 0, n, plan + 3*(D+1), emit, ctx);
+}
+
+// n strictly increasing, evenly spaced ids between ba1 and ba2, in a
+// malloc'ed array of malloc'ed ids.
+ByteArray *ByteArray_GenerateNBetween(ByteArray ba1, ByteArray ba2, size_t n, int withCompression){
+  SpreadCollect c;
+  c.out = malloc(n * sizeof(ByteArray));
+  c.k = 0;
+  c.withCompression = withCompression;
+  IdScratch scratch;
+  initScratch(&scratch);
+  spreadBetween(&scratch, ba1, ba2, n, withCompression, collectSpread, &c);
+  freeScratch(&scratch);
+  return c.out;
+}
+
+int compare(ByteArray a, ByteArray b)
+{
+  for (int i = 0; i < MIN(a.len, b.len); ++i)
+    if(a.data[i] < b.data[i])
+      return -1;
+    else if(a.data[i] > b.data[i])
+      return 1;
+    else
+      continue;
+  if(a.len<b.len)
+    return -1;
+  else if(a.len>b.len)
+    return 1;
+  else
+    return 0;
+}
+
+// Index of the first byte where x and y differ, n if none does. Compares
+// 32/16 bytes per step with AVX2/SSE2 when the compiler targets them, then
+// 8 bytes as a word, then single bytes.
+size_t firstDifference(const uint8_t *x, const uint8_t *y, size_t n){
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i+32 <= n; i += 32){
+    __m256i vx = _mm256_loadu_si256((const __m256i *)(x+i));
+    __m256i vy = _mm256_loadu_si256((const __m256i *)(y+i));
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(vx, vy));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i+16 <= n; i += 16){
+    __m128i vx = _mm_loadu_si128((const __m128i *)(x+i));
+    __m128i vy = _mm_loadu_si128((const __m128i *)(y+i));
+    uint32_t mask = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(vx, vy)) & 0xffff;
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i+8 <= n; i += 8){
+    uint64_t wx, wy;
+    memcpy(&wx, x+i, 8);
+    memcpy(&wy, y+i, 8);
+    uint64_t d = wx ^ wy;
+    if (d != 0){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      return i + __builtin_ctzll(d) / 8;
+#else
+      return i + __builtin_clzll(d) / 8;
+#endif
+    }
+  }
+  for (; i < n; ++i)
+    if (x[i] != y[i])
+      return i;
+  return n;
+}
+
+// Same ordering as compare, with the common prefix skipped by
+// firstDifference instead of a byte loop.
+int compareFast(ByteArray a, ByteArray b){
+  size_t n = MIN(a.len, b.len);
+  size_t i = firstDifference(a.data, b.data, n);
+  if (i < n)
+    return a.data[i] < b.data[i] ? -1 : 1;
+  if (a.len == b.len)
+    return 0;
+  return a.len < b.len ? -1 : 1;
+}
+
+int lessThan(ByteArray a, ByteArray b){
+  return compareFast(a, b) == -1;
+}
+
+int greaterThan(ByteArray a, ByteArray b){
+  return compareFast(a, b) == 1;
+}
+
+int equalsTo(ByteArray a, ByteArray b){
+  return compareFast(a, b) == 0;
+}
+
+// Walks a compressed id one symbol at a time, a 0x7f run being a single
+// symbol with a repeat count.
+typedef struct {
+  const uint8_t *p;
+  const uint8_t *end;
+  uint8_t byte; /**< Current decompressed byte. */
+  size_t run; /**< How many more times `byte` repeats. */
+} RunCursor;
+
+void initRunCursor(RunCursor *c, ByteArray compba){
+  c->p = compba.data;
+  c->end = compba.data + compba.len;
+  c->run = 0;
+}
+
+int nextRun(RunCursor *c){
+  if (c->p == c->end)
+    return 0;
+  if (*c->p >= N128){
+    size_t sum = 0;
+    while (c->p < c->end && *c->p >= N128)
+      sum = sum * N128 + *c->p++ - N128;
+    c->byte = N127;
+    c->run = sum;
+  }
+  else{
+    c->byte = *c->p++;
+    c->run = 1;
+  }
+  return 1;
+}
+
+int compareRuns(ByteArray a, ByteArray b){
+  RunCursor ca, cb;
+  initRunCursor(&ca, a);
+  initRunCursor(&cb, b);
+  for (;;){
+    while (ca.run == 0 && nextRun(&ca));
+    while (cb.run == 0 && nextRun(&cb));
+    if (ca.run == 0)
+      return cb.run == 0 ? 0 : -1;
+    if (cb.run == 0)
+      return 1;
+    if (ca.byte != cb.byte)
+      return ca.byte < cb.byte ? -1 : 1;
+    size_t n = MIN(ca.run, cb.run);
+    ca.run -= n;
+    cb.run -= n;
+  }
+}
+
+// Orders two compressed ids as their decompressed forms would be ordered.
+// Bytes are compared directly up to the first difference; only when that
+// difference falls inside a run count do we walk the runs.
+int ByteArray_CompareCompressed(ByteArray a, ByteArray b){
+  if (isTopVal(a) || isTopVal(b))
+    return isTopVal(a) - isTopVal(b);
+  size_t n = MIN(a.len, b.len);
+  size_t i = firstDifference(a.data, b.data, n);
+  if (i == n){
+    if (a.len == b.len)
+      return 0;
+    return a.len < b.len ? -1 : 1;
+  }
+  if (a.data[i] < N128 && b.data[i] < N128)
+    return a.data[i] < b.data[i] ? -1 : 1;
+  return compareRuns(a, b);
+}
+
+// qsort comparator over ByteArray elements.
+int ByteArray_CompareCompressedPtr(const void *a, const void *b){
+  return ByteArray_CompareCompressed(*(const ByteArray *)a, *(const ByteArray *)b);
+}
+
+int lessThanCompressed(ByteArray a, ByteArray b){
+  return ByteArray_CompareCompressed(a, b) == -1;
+}
+
+///// end of ByteArray
+
+///// InlineId Functions
+
+// Ids of up to ID_INLINE_CAP bytes live inside the 16-byte struct, so a
+// vector of them is contiguous and four ids share a cache line. Longer ids
+// spill to the arena (or heap) and keep their pointer in the tail bytes.
+
+int InlineId_IsInline(const InlineId *id){
+  return id->len <= ID_INLINE_CAP;
+}
+
+uint8_t *InlineId_Data(const InlineId *id){
+  if (InlineId_IsInline(id))
+    return (uint8_t *)id->bytes;
+  uint8_t *p;
+  memcpy(&p, id->bytes + ID_HEAP_OFFSET, sizeof(p));
+  return p;
+}
+
+ByteArray InlineId_View(const InlineId *id){
+  ByteArray ba;
+  ba.len = id->len;
+  ba.data = InlineId_Data(id);
+  return ba;
+}
+
+InlineId InlineId_FromByteArray(IdArena *arena, ByteArray ba){
+  assert(ba.len <= UINT32_MAX);
+  InlineId id;
+  id.len = ba.len;
+  if (InlineId_IsInline(&id))
+    memcpy(id.bytes, ba.data, ba.len);
+  else{
+    uint8_t *p = idAlloc(arena, ba.len);
+    memcpy(p, ba.data, ba.len);
+    memcpy(id.bytes + ID_HEAP_OFFSET, &p, sizeof(p));
+  }
+  return id;
+}
+
+void InlineId_Free(IdArena *arena, InlineId *id){
+  if (!InlineId_IsInline(id))
+    idFree(arena, InlineId_Data(id), id->len);
+  id->len = 0;
+}
+
+// Ids are stored compressed, so they are ordered by their runs.
+int InlineId_Compare(const InlineId *a, const InlineId *b){
+  return ByteArray_CompareCompressed(InlineId_View(a), InlineId_View(b));
+}
+
+///// end of InlineId
+
+///// Tagged 64-bit ids
+
+// Decompressed ids of up to 8 digits fit in a uint64_t: the digits, 7 bits
+// each, left-aligned from bit 63, the length in bits 4..1 and bit 0 set.
+// Padding digits are zero and ids never end in 0x00, so comparing two
+// packed ids is one integer compare, and generating between them is
+// integer arithmetic on the digit field. Longer ids fall back to a heap
+// copy of their digits, whose pointer has bit 0 clear. The top sentinel
+// is UINT64_MAX.
+
+typedef uint64_t TaggedId;
+
+typedef struct {
+  size_t len;
+  uint8_t data[]; /**< Decompressed digits. */
+} TaggedBytes;
+
+#define TAGGED_DIGITS 8
+#define TAGGED_TOP UINT64_MAX
+#define TAGGED_DIGIT_BITS (7 * TAGGED_DIGITS)
+
+static inline int TaggedId_IsPacked(TaggedId t){
+  return t & 1;
+}
+
+static inline size_t TaggedId_Len(TaggedId t){
+  return TaggedId_IsPacked(t) ? (t >> 1) & 15 : ((TaggedBytes *)(uintptr_t)t)->len;
+}
+
+static inline uint64_t TaggedId_Digits(TaggedId t){
+  return t >> (64 - TAGGED_DIGIT_BITS);
+}
+
+static inline TaggedId TaggedId_Pack(uint64_t digits, size_t len){
+  return digits << (64 - TAGGED_DIGIT_BITS) | len << 1 | 1;
+}
+
+TaggedId TaggedId_FromRaw(const uint8_t *raw, size_t len){
+  if (len <= TAGGED_DIGITS){
+    uint64_t digits = 0;
+    for (size_t i = 0; i < TAGGED_DIGITS; ++i)
+      digits = digits << 7 | (i < len ? raw[i] : 0);
+    return TaggedId_Pack(digits, len);
+  }
+  TaggedBytes *b = malloc(sizeof(TaggedBytes) + len);
+  b->len = len;
+  memcpy(b->data, raw, len);
+  return (uintptr_t)b;
+}
+
+// Decompressed digits of `t` in `out`, which holds at least
+// MAX(TaggedId_Len(t), TAGGED_DIGITS) bytes. Returns the length.
+size_t TaggedId_ToRaw(TaggedId t, uint8_t *out){
+  if (t == TAGGED_TOP){
+    out[0] = TopByte;
+    return 1;
+  }
+  if (!TaggedId_IsPacked(t)){
+    TaggedBytes *b = (TaggedBytes *)(uintptr_t)t;
+    memcpy(out, b->data, b->len);
+    return b->len;
+  }
+  uint64_t digits = TaggedId_Digits(t);
+  size_t len = TaggedId_Len(t);
+  for (size_t i = 0; i < len; ++i)
+    out[i] = (digits >> (7 * (TAGGED_DIGITS-1-i))) & N127;
+  return len;
+}
+
+void TaggedId_Free(TaggedId t){
+  if (!TaggedId_IsPacked(t))
+    free((TaggedBytes *)(uintptr_t)t);
+}
+
+int TaggedId_Compare(TaggedId a, TaggedId b){
+  if (TaggedId_IsPacked(a) && TaggedId_IsPacked(b))
+    return (a > b) - (a < b);
+  uint8_t ba[TAGGED_DIGITS], bb[TAGGED_DIGITS];
+  ByteArray x = {0, TaggedId_IsPacked(a) ? ba : ((TaggedBytes *)(uintptr_t)a)->data};
+  ByteArray y = {0, TaggedId_IsPacked(b) ? bb : ((TaggedBytes *)(uintptr_t)b)->data};
+  x.len = TaggedId_IsPacked(a) ? TaggedId_ToRaw(a, ba) : TaggedId_Len(a);
+  y.len = TaggedId_IsPacked(b) ? TaggedId_ToRaw(b, bb) : TaggedId_Len(b);
+  return compare(x, y);
+}
+
+// Integer generation between packed ids: at the shortest depth with a free
+// value, the midpoint, or the value next to the neighbour for appends and
+// prepends like generateRawBetween's increment. Returns 0 when no packed
+// id fits.
+int taggedBetweenPacked(TaggedId a, TaggedId b, TaggedId *out){
+  uint64_t lo56 = TaggedId_Digits(a);
+  uint64_t hi56 = b == TAGGED_TOP ? (uint64_t)1 << TAGGED_DIGIT_BITS : TaggedId_Digits(b);
+  for (size_t depth = 1; depth <= TAGGED_DIGITS; ++depth){
+    int shift = 7 * (TAGGED_DIGITS - depth);
+    uint64_t lo = (lo56 >> shift) + 1;
+    uint64_t hi = ((hi56 + ((uint64_t)1 << shift) - 1) >> shift) - 1;
+    if (hi < lo)
+      continue;
+    uint64_t v = b == TAGGED_TOP ? lo : a == TaggedId_Pack((uint64_t)BottomByte << 49, 1) ? hi : lo + (hi-lo)/2;
+    if ((v & N127) == 0){ // ids never end in 0x00
+      if (v < hi)
+        v++;
+      else if (v > lo)
+        v--;
+      else
+        continue;
+    }
+    *out = TaggedId_Pack(v << shift, depth);
+    return 1;
+  }
+  return 0;
+}
+
+// Id strictly between a and b, packed whenever it fits in 8 digits.
+TaggedId TaggedId_GenerateBetween(TaggedId a, TaggedId b){
+  TaggedId res;
+  if (TaggedId_IsPacked(a) && TaggedId_IsPacked(b) && taggedBetweenPacked(a, b, &res))
+    return res;
+  size_t al = MAX(TaggedId_Len(a), TAGGED_DIGITS), bl = b == TAGGED_TOP ? 1 : MAX(TaggedId_Len(b), TAGGED_DIGITS);
+  uint8_t small[4*TAGGED_DIGITS+2];
+  uint8_t *buf = al+bl <= 2*TAGGED_DIGITS ? small : malloc(2*(al+bl)+2);
+  uint8_t *ra = buf, *rb = buf+al, *out = buf+al+bl;
+  al = TaggedId_ToRaw(a, ra);
+  bl = TaggedId_ToRaw(b, rb);
+  res = TaggedId_FromRaw(out, generateRawBetween(ra, al, rb, bl, out));
+  if (buf != small)
+    free(buf);
+  return res;
+}
+
+///// end of Tagged ids
+
+///// Sequence imlpemented as growable array
+
+void initArray(Array *a, size_t initialSize) {
+  a->ba = malloc(initialSize * sizeof(InlineId));
+  a->used = 0;
+  a->size = initialSize;
+  a->arena = NULL;
+  initScratch(&a->scratch);
+  a->strategy = STRATEGY_BISECT;
+  a->site = SITE_NONE;
+}
+
+void initArrayWithArena(Array *a, size_t initialSize, IdArena *arena) {
+  initArray(a, initialSize);
+  a->arena = arena;
+}
+
+// Id between two stored neighbours, NULL standing for the bottom/top
+// sentinel. The result lives in `scratch`.
+ByteArray GenerateIdViewBetween(IdScratch *scratch, const InlineId *left, const InlineId *right, IdStrategy strategy, uint32_t site) {
+  // sentinels are shared, nothing to allocate for them
+  ByteArray bal = {1, &BottomByte};
+  ByteArray bar = {1, &TopByte};
+  if (left != NULL)
+    bal = InlineId_View(left);
+  if (right != NULL)
+    bar = InlineId_View(right);
+  return ByteArray_GenerateBetweenSite(scratch, bal, bar, strategy, site, Compression);
+}
+
+// Generated id for position `pos`, living in the Array's scratch.
+ByteArray GenerateIdViewAt(Array *a, int pos) {
+  if (a->used == 0) // empty Array
+    return GenerateIdViewBetween(&a->scratch, NULL, NULL, a->strategy, a->site);
+  else // not empty Array
+    if (pos == 0) // insert in the begining
+      return GenerateIdViewBetween(&a->scratch, NULL, &a->ba[pos], a->strategy, a->site);
+    else if (pos == a->used) // insert in the end
+      return GenerateIdViewBetween(&a->scratch, &a->ba[pos-1], NULL, a->strategy, a->site);
+    else
+      return GenerateIdViewBetween(&a->scratch, &a->ba[pos-1], &a->ba[pos], a->strategy, a->site);
+}
+
+ByteArray GenerateIdAt(Array *a, int pos) {
+  ByteArray view = GenerateIdViewAt(a, pos);
+  ByteArray res;
+  res.len = view.len;
+  res.data = idAlloc(a->arena, res.len);
+  memcpy(res.data, view.data, res.len);
+  return res;
+}
+
+void insertArrayAt(Array *a, int pos) {
+  STAT_BEGIN(t);
+  // a->used is the number of used entries, because a->ba[a->used++] updates a->used only *after* the array has been accessed.
+  // Therefore a->used can go up to a->size 
+  if (pos <= a->used+1) {
+    if (a->used == a->size) {
+      a->size *= 2;
+      a->ba = realloc(a->ba, a->size * sizeof(InlineId));
+    }
+    // shift values right
+    if (a->used > 0 || pos < a->used)
+      for (int i = a->used-1; i >= pos; --i)
+        a->ba[i+1] = a->ba[i];
+    // inline-sized ids are copied straight out of the scratch
+    ByteArray element = GenerateIdViewAt(a, pos);
+    a->ba[pos] = InlineId_FromByteArray(a->arena, element);
+    ++a->used;
+    STAT_END(STAT_INSERT, t);
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+typedef struct {
+  Array *a;
+  int pos;
+  uint8_t *comp; /**< Compression buffer, sized for the longest id. */
+} ArraySpread;
+
+void storeArraySpread(const uint8_t *raw, size_t len, void *ctx){
+  ArraySpread *sp = ctx;
+  ByteArray id = {compressInto(raw, len, sp->comp), sp->comp};
+  sp->a->ba[sp->pos++] = InlineId_FromByteArray(sp->a->arena, id);
+}
+
+typedef struct {
+  const uint8_t *plan;
+  size_t D;
+  size_t from;
+  size_t to;
+  ArraySpread sp;
+  int onThread; /**< Generated by its own thread, to be joined. */
+#ifdef IDGEN_STATS
+  IdStatsT stats; /**< The thread's stats, folded into the caller's after the join. */
+#endif
+} SpreadSlice;
+
+void *storeSpreadSlice(void *arg){
+  SpreadSlice *sl = arg;
+  uint8_t *v = malloc(sl->D + 1);
+  emitSpreadRange(sl->plan, sl->D, sl->from, sl->to, v, storeArraySpread, &sl->sp);
+  free(v);
+  return NULL;
+}
+
+void *spreadSliceThread(void *arg){
+  SpreadSlice *sl = arg;
+  storeSpreadSlice(sl);
+  STAT_EXPORT(sl->stats);
+  return NULL;
+}
+
+// insertArrayAtN with the spread cut into `threads` contiguous slices of
+// the id space between the neighbours, each generated on its own thread
+// straight into its slots. The ids are exactly those of insertArrayAtN;
+// importing a document is insertArrayAtNParallel(a, 0, n, threads) on an
+// empty Array. Arenas are not thread-safe, so with one the ids are
+// generated on the calling thread.
+void insertArrayAtNParallel(Array *a, int pos, size_t n, int threads) {
+  if (pos <= a->used) {
+    if (a->used + n > a->size) {
+      a->size = MAX(2*a->size, a->used + n);
+      a->ba = realloc(a->ba, a->size * sizeof(InlineId));
+    }
+    memmove(a->ba+pos+n, a->ba+pos, (a->used-pos) * sizeof(InlineId));
+    ByteArray bal = {1, &BottomByte};
+    ByteArray bar = {1, &TopByte};
+    if (pos > 0)
+      bal = InlineId_View(&a->ba[pos-1]);
+    if (pos < a->used)
+      bar = InlineId_View(&a->ba[pos+n]);
+    size_t D;
+    const uint8_t *plan = planSpreadBetween(&a->scratch, bal, bar, n, Compression, &D);
+    // a thread is only worth starting for a few thousand ids
+    if (a->arena != NULL)
+      threads = 1;
+    threads = MAX(1, MIN(threads, (int)(n / 4096) + 1));
+    SpreadSlice *slices = malloc(threads * sizeof(SpreadSlice));
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; ++t){
+      SpreadSlice *sl = &slices[t];
+      sl->plan = plan;
+      sl->D = D;
+      sl->from = n * t / threads;
+      sl->to = n * (t+1) / threads;
+      sl->sp.a = a;
+      sl->sp.pos = pos + sl->from;
+      sl->sp.comp = malloc(D + 1); // compressed ids are no longer than raw ones
+      sl->onThread = t > 0 && pthread_create(&tids[t], NULL, spreadSliceThread, sl) == 0;
+      // out of threads: the slice is generated here instead
+      if (t > 0 && !sl->onThread)
+        storeSpreadSlice(sl);
+    }
+    storeSpreadSlice(&slices[0]);
+    for (int t = 1; t < threads; ++t)
+      if (slices[t].onThread){
+        pthread_join(tids[t], NULL);
+        STAT_ABSORB(slices[t].stats);
+      }
+    for (int t = 0; t < threads; ++t)
+      free(slices[t].sp.comp);
+    free(slices);
+    free(tids);
+    a->used += n;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+// Inserts n consecutive elements at pos: the tail moves once and the new
+// ids are spread evenly between the two neighbours.
+void insertArrayAtN(Array *a, int pos, size_t n) {
+  insertArrayAtNParallel(a, pos, n, 1);
+}
+
+// First position whose id is not below the compressed `id`.
+int lowerBoundArray(Array *a, ByteArray id) {
+  int lo = 0, hi = a->used;
+  while (lo < hi){
+    int mid = lo + (hi-lo)/2;
+    if (ByteArray_CompareCompressed(InlineId_View(&a->ba[mid]), id) < 0)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Position of the compressed `id`, or -1 if it is not in the sequence.
+int indexOfArray(Array *a, ByteArray id) {
+  int pos = lowerBoundArray(a, id);
+  if (pos < a->used && ByteArray_CompareCompressed(InlineId_View(&a->ba[pos]), id) == 0)
+    return pos;
+  return -1;
+}
+
+// Merges `k` foreign compressed ids, sorted ascending, in one pass. Ids
+// already in the sequence or repeated in the batch are skipped, and they
+// must not point into the Array itself. Returns how many were inserted.
+size_t mergeArray(Array *a, ByteArray *ids, size_t k) {
+  if (k == 0)
+    return 0;
+  if (a->used + k > a->size) {
+    a->size = MAX(2*a->size, a->used + k);
+    a->ba = realloc(a->ba, a->size * sizeof(InlineId));
+  }
+  // ids below the first foreign one stay put, the rest make room for k
+  size_t i = lowerBoundArray(a, ids[0]), end = a->used + k;
+  memmove(a->ba + i + k, a->ba + i, (a->used - i) * sizeof(InlineId));
+  size_t w = i, r = i + k, j = 0, inserted = 0;
+  while (j < k) {
+    assert(j == 0 || ByteArray_CompareCompressed(ids[j-1], ids[j]) <= 0);
+    int c = r < end ? ByteArray_CompareCompressed(InlineId_View(&a->ba[r]), ids[j]) : 1;
+    if (c < 0)
+      a->ba[w++] = a->ba[r++];
+    else if (c == 0 || (w > 0 && ByteArray_CompareCompressed(InlineId_View(&a->ba[w-1]), ids[j]) == 0))
+      j++;
+    else {
+      // w never catches up with r: it trails by the ids not yet merged
+      a->ba[w++] = InlineId_FromByteArray(a->arena, ids[j++]);
+      inserted++;
+    }
+  }
+  memmove(a->ba + w, a->ba + r, (end - r) * sizeof(InlineId));
+  a->used += inserted;
+  return inserted;
+}
+
+void printArray(Array *a) {
+  for (int i = 0; i < a->used; ++i)
+    printByteArray(InlineId_View(&a->ba[i]));
+}
+
+void deleteArrayAt(Array *a, int pos) {
+  STAT_BEGIN(t);
+  if (pos < a->used) {
+    InlineId_Free(a->arena, &a->ba[pos]);
+    // shift values left
+    memmove(a->ba+pos, a->ba+pos+1, (a->used-pos-1) * sizeof(InlineId));
+    --a->used;
+    // halve once three quarters are unused, so shrinking stays amortized
+    if (a->size > 16 && a->used < a->size/4) {
+      a->size /= 2;
+      a->ba = realloc(a->ba, a->size * sizeof(InlineId));
+    }
+    STAT_END(STAT_DELETE, t);
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+// Deletes n consecutive elements at pos, freeing their ids, with one move
+// of the tail.
+void deleteArrayRange(Array *a, int pos, size_t n) {
+  if (pos + n <= a->used) {
+    for (size_t i = pos; i < pos + n; ++i)
+      InlineId_Free(a->arena, &a->ba[i]);
+    memmove(a->ba+pos, a->ba+pos+n, (a->used-pos-n) * sizeof(InlineId));
+    a->used -= n;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+void freeArray(Array *a) {
+  free(a->ba);
+  a->ba = NULL;
+  a->used = a->size = 0;
+  freeScratch(&a->scratch);
+}
+
+// Releases the sequence together with all of its ids; with an arena this
+// is a handful of block frees regardless of the number of elements.
+void freeDocument(Array *a) {
+  if (a->arena != NULL)
+    freeArena(a->arena);
+  else
+    for (int i = 0; i < a->used; ++i)
+      InlineId_Free(NULL, &a->ba[i]);
+  freeArray(a);
+}
+
+void printArrayBytes(Array *a){
+  // at least 10 buckets, as many as the longest id needs
+  int size = 10;
+  for (int i = 0; i < a->used; ++i)
+    size = MAX(size, a->ba[i].len);
+  int *b = calloc(size, sizeof(int));
+  for (int i = 0; i < a->used; ++i)
+    b[a->ba[i].len-1]++;
+  for (int i = 0; i < size; ++i)
+    printf("ids of size %d Byte(s): %d\n", i+1, b[i]);
+  free(b);
+}
+
+void randomInsertTest(int max){
+  Array a;
+  initArray(&a, max);
+  while(max > 0){
+    int pos = rand() % (a.used+1);
+    int k = MAX(rand() % max, 1);
+    // int k = 1;
+    printf("pos is: %d\n", pos);
+    printf("k is: %d\n", k);
+    for (int i = 0; i < MIN(k, max); ++i)
+      insertArrayAt(&a, pos+i);
+    max = max-k;
+  };
+  printArray(&a);
+  printArrayBytes(&a);
+  freeArray(&a);
+}
+
+///// end of Seq as Growable Array
+
+///// Sequence implemented as gap buffer
+
+// The growable array with its free slots kept in a gap at the last edit
+// position instead of at the end. An edit first moves the gap there,
+// which shifts only the elements between the old and new positions, so
+// typing and deleting near the previous edit costs O(1) instead of a move
+// of the whole tail.
+
+typedef struct {
+  InlineId *ba;
+  size_t gapStart; /**< First free slot, also the position of the last edit. */
+  size_t gapEnd; /**< First used slot after the gap. */
+  size_t size;
+  size_t used;
+  IdScratch scratch;
+  IdStrategy strategy;
+  uint32_t site; /**< Replica suffix of generated ids, SITE_NONE by default. */
+} GapBuffer;
+
+void initGapBuffer(GapBuffer *g, size_t initialSize) {
+  initialSize = MAX(initialSize, 1);
+  g->ba = malloc(initialSize * sizeof(InlineId));
+  g->gapStart = 0;
+  g->gapEnd = g->size = initialSize;
+  g->used = 0;
+  initScratch(&g->scratch);
+  g->strategy = STRATEGY_BISECT;
+  g->site = SITE_NONE;
+}
+
+// Copies the ids of `a`, leaving the gap at the end.
+void initGapBufferFromArray(GapBuffer *g, Array *a) {
+  initGapBuffer(g, a->used + a->used/2);
+  for (size_t i = 0; i < a->used; ++i)
+    g->ba[i] = InlineId_FromByteArray(NULL, InlineId_View(&a->ba[i]));
+  g->gapStart = g->used = a->used;
+  g->strategy = a->strategy;
+  g->site = a->site;
+}
+
+InlineId *getGapBufferAt(GapBuffer *g, int pos) {
+  if (pos < 0 || pos >= g->used)
+    return NULL;
+  return &g->ba[pos < g->gapStart ? pos : pos + g->gapEnd - g->gapStart];
+}
+
+void moveGap(GapBuffer *g, size_t pos) {
+  if (pos < g->gapStart){
+    size_t n = g->gapStart - pos;
+    memmove(g->ba + g->gapEnd - n, g->ba + pos, n * sizeof(InlineId));
+    g->gapStart -= n;
+    g->gapEnd -= n;
+  }
+  else if (pos > g->gapStart){
+    size_t n = pos - g->gapStart;
+    memmove(g->ba + g->gapStart, g->ba + g->gapEnd, n * sizeof(InlineId));
+    g->gapStart += n;
+    g->gapEnd += n;
+  }
+}
+
+ByteArray GenerateGapIdViewAt(GapBuffer *g, int pos) {
+  return GenerateIdViewBetween(&g->scratch, getGapBufferAt(g, pos-1), getGapBufferAt(g, pos), g->strategy, g->site);
+}
+
+void insertGapBufferAt(GapBuffer *g, int pos) {
+  if (pos <= g->used) {
+    if (g->gapStart == g->gapEnd){
+      // double, moving the elements after the gap to the new end
+      size_t tail = g->size - g->gapEnd;
+      g->size *= 2;
+      g->ba = realloc(g->ba, g->size * sizeof(InlineId));
+      memmove(g->ba + g->size - tail, g->ba + g->gapEnd, tail * sizeof(InlineId));
+      g->gapEnd = g->size - tail;
+    }
+    // generate before moving the gap: the neighbours are looked up by position
+    ByteArray id = GenerateGapIdViewAt(g, pos);
+    moveGap(g, pos);
+    g->ba[g->gapStart++] = InlineId_FromByteArray(NULL, id);
+    ++g->used;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+// Deleting widens the gap, the slot is reused by the next insert.
+void deleteGapBufferAt(GapBuffer *g, int pos) {
+  if (pos < g->used) {
+    moveGap(g, pos);
+    InlineId_Free(NULL, &g->ba[g->gapEnd++]);
+    --g->used;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+void printGapBuffer(GapBuffer *g) {
+  for (int i = 0; i < g->used; ++i)
+    printByteArray(InlineId_View(getGapBufferAt(g, i)));
+}
+
+void freeGapBuffer(GapBuffer *g) {
+  for (int i = 0; i < g->used; ++i)
+    InlineId_Free(NULL, getGapBufferAt(g, i));
+  free(g->ba);
+  g->ba = NULL;
+  g->gapStart = g->gapEnd = g->size = g->used = 0;
+  freeScratch(&g->scratch);
+}
+
+///// end of Seq as Gap Buffer
+
+///// Position index
+
+// Prefix sums of per-block counts in a Fenwick tree: updating a count,
+// summing the blocks before one and finding the block that holds the k-th
+// unit are all O(log blocks). Over a bitmap with one block per
+// RANK_BLOCK_WORDS words, the last steps of rank and select are popcounts
+// within one block, so both are O(log n) whatever the dead slots.
+
+#define RANK_BLOCK_WORDS 8
+#define RANK_BLOCK_BITS (64 * RANK_BLOCK_WORDS)
+
+typedef struct {
+  size_t *tree; /**< 1-based; tree[i] sums the counts of blocks (i - lowbit(i), i]. */
+  size_t n; /**< Number of blocks. */
+  size_t top; /**< Highest power of two <= n, where searches start. */
+} Fenwick;
+
+// Builds the tree over counts[0..n) in O(n).
+void initFenwick(Fenwick *f, const size_t *counts, size_t n) {
+  f->n = n;
+  f->tree = malloc((n + 1) * sizeof(size_t));
+  f->tree[0] = 0;
+  memcpy(f->tree + 1, counts, n * sizeof(size_t));
+  for (size_t i = 1; i <= n; ++i){
+    size_t j = i + (i & -i);
+    if (j <= n)
+      f->tree[j] += f->tree[i];
+  }
+  for (f->top = 1; f->top * 2 <= n; f->top *= 2);
+}
+
+void fenwickAdd(Fenwick *f, size_t block, int delta) {
+  for (size_t i = block + 1; i <= f->n; i += i & -i)
+    f->tree[i] += delta;
+}
+
+// Sum of the counts of the blocks before `block`.
+size_t fenwickPrefix(Fenwick *f, size_t block) {
+  size_t sum = 0;
+  for (size_t i = block; i > 0; i -= i & -i)
+    sum += f->tree[i];
+  return sum;
+}
+
+// Block holding unit *k (0-based), which becomes its offset in that block.
+size_t fenwickSearch(Fenwick *f, size_t *k) {
+  size_t pos = 0;
+  for (size_t step = f->top; step > 0; step /= 2)
+    if (pos + step <= f->n && f->tree[pos + step] <= *k){
+      pos += step;
+      *k -= f->tree[pos];
+    }
+  return pos;
+}
+
+void freeFenwick(Fenwick *f) {
+  free(f->tree);
+  f->tree = NULL;
+  f->n = 0;
+}
+
+// Position of the k-th (0-based) set bit of w.
+size_t selectInWord(uint64_t w, size_t k) {
+  size_t off = 0;
+  for (int width = 32; width >= 8; width /= 2){
+    size_t c = __builtin_popcountll(w & ((1ull << width) - 1));
+    if (k >= c){
+      k -= c;
+      w >>= width;
+      off += width;
+    }
+  }
+  while (k-- > 0)
+    w &= w - 1;
+  return off + __builtin_ctzll(w);
+}
+
+void indexBitmap(Fenwick *f, const uint64_t *bits, size_t words) {
+  size_t n = (words + RANK_BLOCK_WORDS - 1) / RANK_BLOCK_WORDS;
+  size_t *counts = calloc(n, sizeof(size_t));
+  for (size_t w = 0; w < words; ++w)
+    counts[w / RANK_BLOCK_WORDS] += __builtin_popcountll(bits[w]);
+  initFenwick(f, counts, n);
+  free(counts);
+}
+
+// Set bits before `slot`.
+size_t bitmapRank(const uint64_t *bits, Fenwick *f, size_t slot) {
+  size_t w = slot / RANK_BLOCK_BITS * RANK_BLOCK_WORDS;
+  size_t r = fenwickPrefix(f, slot / RANK_BLOCK_BITS);
+  for (; w < slot / 64; ++w)
+    r += __builtin_popcountll(bits[w]);
+  if (slot % 64 != 0)
+    r += __builtin_popcountll(bits[w] & ((1ull << (slot % 64)) - 1));
+  return r;
+}
+
+// Slot of set bit number `pos`, which must exist.
+size_t bitmapSelect(const uint64_t *bits, Fenwick *f, size_t pos) {
+  size_t w = fenwickSearch(f, &pos) * RANK_BLOCK_WORDS;
+  for (;; ++w){
+    size_t c = __builtin_popcountll(bits[w]);
+    if (pos < c)
+      return w * 64 + selectInWord(bits[w], pos);
+    pos -= c;
+  }
+}
+
+///// end of Position index
+
+///// Sequence with lazy deletes
+
+// A growable array whose deletes only clear the slot's bit in a liveness
+// bitmap and free its id. Positions count live slots, found by rank/select
+// over the bitmap and its position index. An insert between two live ids reuses a dead slot
+// lying between them, and once half the slots are dead they are squeezed
+// out in one pass, so a burst of deletes costs O(1) per element.
+
+#define LAZY_MIN_COMPACT 64
+
+typedef struct {
+  Array a; /**< Slots in id order, live and dead; a.used counts both. */
+  uint64_t *live; /**< Bit i of word i/64 is set while slot i holds an id. */
+  size_t words; /**< Allocated words of `live`. */
+  size_t used; /**< Live ids. */
+  Fenwick index; /**< Live slots per RANK_BLOCK_WORDS words of `live`. */
+} LazyArray;
+
+void initLazyArray(LazyArray *l, size_t initialSize) {
+  initArray(&l->a, MAX(initialSize, 1));
+  l->words = (l->a.size + 63) / 64;
+  l->live = calloc(l->words, sizeof(uint64_t));
+  l->used = 0;
+  indexBitmap(&l->index, l->live, l->words);
+}
+
+// Live slots before `slot`.
+size_t rankLazyArray(LazyArray *l, size_t slot) {
+  return bitmapRank(l->live, &l->index, slot);
+}
+
+// Slot of the live id at position `pos`, which must be < l->used.
+size_t selectLazyArray(LazyArray *l, size_t pos) {
+  return bitmapSelect(l->live, &l->index, pos);
+}
+
+void setLazySlot(LazyArray *l, size_t slot, int isLive) {
+  if (isLive)
+    l->live[slot / 64] |= 1ull << (slot % 64);
+  else
+    l->live[slot / 64] &= ~(1ull << (slot % 64));
+  fenwickAdd(&l->index, slot / RANK_BLOCK_BITS, isLive ? 1 : -1);
+}
+
+// First live slot at or after `slot`, or a.used if there is none.
+size_t nextLiveSlot(LazyArray *l, size_t slot) {
+  if (slot >= l->a.used)
+    return l->a.used;
+  size_t w = slot / 64;
+  uint64_t bits = l->live[w] & (~0ull << (slot % 64));
+  while (bits == 0 && ++w < l->words)
+    bits = l->live[w];
+  return bits == 0 ? l->a.used : MIN(w * 64 + __builtin_ctzll(bits), l->a.used);
+}
+
+InlineId *getLazyArrayAt(LazyArray *l, int pos) {
+  if (pos < 0 || pos >= l->used)
+    return NULL;
+  return &l->a.ba[selectLazyArray(l, pos)];
+}
+
+// Squeezes the dead slots out and gives their memory back.
+void compactLazyArray(LazyArray *l) {
+  size_t k = 0;
+  for (size_t s = nextLiveSlot(l, 0); s < l->a.used; s = nextLiveSlot(l, s+1))
+    l->a.ba[k++] = l->a.ba[s];
+  l->a.used = k;
+  l->a.size = MAX(k + k/2, 16);
+  l->a.ba = realloc(l->a.ba, l->a.size * sizeof(InlineId));
+  l->words = (l->a.size + 63) / 64;
+  l->live = realloc(l->live, l->words * sizeof(uint64_t));
+  memset(l->live, 0, l->words * sizeof(uint64_t));
+  for (size_t w = 0; w < k / 64; ++w)
+    l->live[w] = ~0ull;
+  if (k % 64 != 0)
+    l->live[k / 64] = (1ull << (k % 64)) - 1;
+  freeFenwick(&l->index);
+  indexBitmap(&l->index, l->live, l->words);
+}
+
+// Opens a live slot at `slot`, shifting the slots and bits above it.
+void openLazySlot(LazyArray *l, size_t slot) {
+  if (l->a.used == l->a.size){
+    l->a.size *= 2;
+    l->a.ba = realloc(l->a.ba, l->a.size * sizeof(InlineId));
+    size_t words = (l->a.size + 63) / 64;
+    l->live = realloc(l->live, words * sizeof(uint64_t));
+    memset(l->live + l->words, 0, (words - l->words) * sizeof(uint64_t));
+    l->words = words;
+  }
+  memmove(l->a.ba+slot+1, l->a.ba+slot, (l->a.used-slot) * sizeof(InlineId));
+  // shift the bitmap left by one from `slot`, the top word first
+  size_t w = slot / 64;
+  for (size_t i = l->a.used / 64; i > w; --i)
+    l->live[i] = l->live[i] << 1 | l->live[i-1] >> 63;
+  uint64_t low = (1ull << (slot % 64)) - 1;
+  l->live[w] = (l->live[w] & low) | (l->live[w] & ~low) << 1 | 1ull << (slot % 64);
+  ++l->a.used;
+  // bits crossed block boundaries, recount: O(n / RANK_BLOCK_BITS) next
+  // to the O(n) move
+  freeFenwick(&l->index);
+  indexBitmap(&l->index, l->live, l->words);
+}
+
+void insertLazyArrayAt(LazyArray *l, int pos) {
+  if (pos <= l->used) {
+    // the neighbours' slots; anything between them is dead
+    size_t left = pos > 0 ? selectLazyArray(l, pos-1) : SIZE_MAX;
+    size_t right = pos < l->used ? selectLazyArray(l, pos) : nextLiveSlot(l, left+1);
+    ByteArray id = GenerateIdViewBetween(&l->a.scratch, pos > 0 ? &l->a.ba[left] : NULL, pos < l->used ? &l->a.ba[right] : NULL, l->a.strategy, l->a.site);
+    size_t slot = right;
+    if (right > left+1)
+      setLazySlot(l, --slot, 1);
+    else
+      openLazySlot(l, slot);
+    l->a.ba[slot] = InlineId_FromByteArray(l->a.arena, id);
+    ++l->used;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+void maybeCompactLazyArray(LazyArray *l) {
+  if (l->a.used >= LAZY_MIN_COMPACT && l->used < l->a.used/2)
+    compactLazyArray(l);
+}
+
+// Deletes n consecutive ids at pos: one select, then a walk over the bitmap.
+void deleteLazyArrayRange(LazyArray *l, int pos, size_t n) {
+  if (pos + n <= l->used) {
+    size_t slot = n > 0 ? selectLazyArray(l, pos) : 0;
+    for (size_t i = 0; i < n; ++i, slot = nextLiveSlot(l, slot+1)){
+      InlineId_Free(l->a.arena, &l->a.ba[slot]);
+      setLazySlot(l, slot, 0);
+    }
+    l->used -= n;
+    maybeCompactLazyArray(l);
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+void deleteLazyArrayAt(LazyArray *l, int pos) {
+  deleteLazyArrayRange(l, pos, 1);
+}
+
+// Position of the compressed `id`, or -1 if it is not in the sequence:
+// binary search over the slots, stepping off dead ones.
+int indexOfLazyArray(LazyArray *l, ByteArray id) {
+  size_t lo = 0, hi = l->a.used;
+  while (lo < hi){
+    size_t mid = nextLiveSlot(l, lo + (hi - lo) / 2);
+    if (mid >= hi){
+      hi = lo + (hi - lo) / 2;
+      continue;
+    }
+    int c = ByteArray_CompareCompressed(InlineId_View(&l->a.ba[mid]), id);
+    if (c == 0)
+      return rankLazyArray(l, mid);
+    if (c < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return -1;
+}
+
+void printLazyArray(LazyArray *l) {
+  for (size_t s = nextLiveSlot(l, 0); s < l->a.used; s = nextLiveSlot(l, s+1))
+    printByteArray(InlineId_View(&l->a.ba[s]));
+}
+
+void freeLazyArray(LazyArray *l) {
+  for (size_t s = nextLiveSlot(l, 0); s < l->a.used; s = nextLiveSlot(l, s+1))
+    InlineId_Free(l->a.arena, &l->a.ba[s]);
+  free(l->live);
+  l->live = NULL;
+  l->words = l->used = 0;
+  freeFenwick(&l->index);
+  freeArray(&l->a);
+}
+
+///// end of Seq with Lazy Deletes
+
+///// Sequence implemented as order-statistic treap
+
+// Same operations as the growable array, each in O(log n) expected: nodes
+// are ordered by position (which is also id order) and carry their
+// subtree size.
+
+typedef struct _TreeNode {
+  InlineId id;
+  struct _TreeNode *left;
+  struct _TreeNode *right;
+  uint32_t prio; /**< Heap priority keeping the treap balanced. */
+  size_t count; /**< Number of nodes in this subtree. */
+} TreeNode;
+
+typedef struct {
+  TreeNode *root;
+  size_t used;
+  uint32_t seed; /**< xorshift state for node priorities. */
+  IdArena *arena; /**< Where ids and nodes are allocated, NULL for the C heap. */
+  IdScratch scratch;
+  IdStrategy strategy;
+  uint32_t site; /**< Replica suffix of generated ids, SITE_NONE by default. */
+} Tree;
+
+void initTree(Tree *t) {
+  t->root = NULL;
+  t->used = 0;
+  t->seed = 2463534242u;
+  t->arena = NULL;
+  initScratch(&t->scratch);
+  t->strategy = STRATEGY_BISECT;
+  t->site = SITE_NONE;
+}
+
+void initTreeWithArena(Tree *t, IdArena *arena) {
+  initTree(t);
+  t->arena = arena;
+}
+
+size_t treeCount(TreeNode *n) {
+  return n == NULL ? 0 : n->count;
+}
+
+void treeUpdate(TreeNode *n) {
+  n->count = 1 + treeCount(n->left) + treeCount(n->right);
+}
+
+// Splits n into its first k nodes and the rest.
+void treeSplit(TreeNode *n, size_t k, TreeNode **l, TreeNode **r) {
+  if (n == NULL){
+    *l = *r = NULL;
+    return;
+  }
+  if (treeCount(n->left) < k){
+    treeSplit(n->right, k - treeCount(n->left) - 1, &n->right, r);
+    *l = n;
+  }
+  else{
+    treeSplit(n->left, k, l, &n->left);
+    *r = n;
+  }
+  treeUpdate(n);
+}
+
+TreeNode *treeMerge(TreeNode *l, TreeNode *r) {
+  if (l == NULL)
+    return r;
+  if (r == NULL)
+    return l;
+  if (l->prio > r->prio){
+    l->right = treeMerge(l->right, r);
+    treeUpdate(l);
+    return l;
+  }
+  r->left = treeMerge(l, r->left);
+  treeUpdate(r);
+  return r;
+}
+
+InlineId *getTreeAt(Tree *t, int pos) {
+  TreeNode *n = t->root;
+  size_t k = pos;
+  while (n != NULL){
+    size_t lc = treeCount(n->left);
+    if (k < lc)
+      n = n->left;
+    else if (k == lc)
+      return &n->id;
+    else{
+      k -= lc+1;
+      n = n->right;
+    }
+  }
+  return NULL;
+}
+
+ByteArray GenerateTreeIdViewAt(Tree *t, int pos) {
+  InlineId *left = pos > 0 ? getTreeAt(t, pos-1) : NULL;
+  InlineId *right = pos < t->used ? getTreeAt(t, pos) : NULL;
+  return GenerateIdViewBetween(&t->scratch, left, right, t->strategy, t->site);
+}
+
+TreeNode *newTreeNode(Tree *t, ByteArray id) {
+  TreeNode *n = (TreeNode *)idAlloc(t->arena, sizeof(TreeNode));
+  n->id = InlineId_FromByteArray(t->arena, id);
+  n->left = n->right = NULL;
+  t->seed ^= t->seed << 13;
+  t->seed ^= t->seed >> 17;
+  t->seed ^= t->seed << 5;
+  n->prio = t->seed;
+  n->count = 1;
+  return n;
+}
+
+void insertTreeAt(Tree *t, int pos) {
+  if (pos <= t->used) {
+    TreeNode *n = newTreeNode(t, GenerateTreeIdViewAt(t, pos));
+    TreeNode *l, *r;
+    treeSplit(t->root, pos, &l, &r);
+    t->root = treeMerge(treeMerge(l, n), r);
+    ++t->used;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+void deleteTreeAt(Tree *t, int pos) {
+  if (pos < t->used) {
+    TreeNode *l, *m, *r;
+    treeSplit(t->root, pos, &l, &r);
+    treeSplit(r, 1, &m, &r);
+    InlineId_Free(t->arena, &m->id);
+    idFree(t->arena, (uint8_t *)m, sizeof(TreeNode));
+    t->root = treeMerge(l, r);
+    --t->used;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+// Position of the compressed `id`, or -1 if it is not in the sequence.
+int indexOfTree(Tree *t, ByteArray id) {
+  TreeNode *n = t->root;
+  size_t before = 0;
+  while (n != NULL){
+    int c = ByteArray_CompareCompressed(id, InlineId_View(&n->id));
+    if (c == 0)
+      return before + treeCount(n->left);
+    if (c < 0)
+      n = n->left;
+    else{
+      before += treeCount(n->left) + 1;
+      n = n->right;
+    }
+  }
+  return -1;
+}
+
+// Splits into the ids below the compressed `id` and the rest.
+void treeSplitKey(TreeNode *n, ByteArray id, TreeNode **l, TreeNode **r) {
+  if (n == NULL){
+    *l = *r = NULL;
+    return;
+  }
+  if (ByteArray_CompareCompressed(InlineId_View(&n->id), id) < 0){
+    treeSplitKey(n->right, id, &n->right, r);
+    *l = n;
+  }
+  else{
+    treeSplitKey(n->left, id, l, &n->left);
+    *r = n;
+  }
+  treeUpdate(n);
+}
+
+// mergeArray for the treap: every foreign id costs O(log n), so the batch
+// is O(k log n) whatever the size of the sequence.
+size_t mergeTree(Tree *t, ByteArray *ids, size_t k) {
+  size_t inserted = 0;
+  for (size_t j = 0; j < k; ++j){
+    assert(j == 0 || ByteArray_CompareCompressed(ids[j-1], ids[j]) <= 0);
+    if (indexOfTree(t, ids[j]) >= 0)
+      continue;
+    TreeNode *l, *r;
+    treeSplitKey(t->root, ids[j], &l, &r);
+    t->root = treeMerge(treeMerge(l, newTreeNode(t, ids[j])), r);
+    ++t->used;
+    ++inserted;
+  }
+  return inserted;
+}
+
+void printTreeNode(TreeNode *n) {
+  if (n == NULL)
+    return;
+  printTreeNode(n->left);
+  printByteArray(InlineId_View(&n->id));
+  printTreeNode(n->right);
+}
+
+void printTree(Tree *t) {
+  printTreeNode(t->root);
+}
+
+void freeTreeNode(Tree *t, TreeNode *n) {
+  if (n == NULL)
+    return;
+  freeTreeNode(t, n->left);
+  freeTreeNode(t, n->right);
+  InlineId_Free(t->arena, &n->id);
+  idFree(t->arena, (uint8_t *)n, sizeof(TreeNode));
+}
+
+void freeTree(Tree *t) {
+  freeTreeNode(t, t->root);
+  t->root = NULL;
+  t->used = 0;
+  freeScratch(&t->scratch);
+}
+
+///// end of Seq as Treap
+
+///// Persistent sequence as copy-on-write treap
+
+// Versions of a document that share every subtree they have in common.
+// snapshotPTree only takes a reference to the root; an edit copies the
+// nodes on the paths it walks that another version still points to, and
+// updates the rest in place. Holding v versions of an n-id document costs
+// n + O(v log n) nodes. Reference counts are plain integers: versions of
+// one document belong to one thread.
+
+typedef struct _PTreeNode {
+  InlineId id; /**< Never changes, copies of a node get their own copy of it. */
+  struct _PTreeNode *left;
+  struct _PTreeNode *right;
+  uint32_t prio;
+  uint32_t refs; /**< Versions and parent nodes pointing here. */
+  size_t count;
+} PTreeNode;
+
+typedef struct {
+  PTreeNode *root;
+  size_t used;
+  uint32_t seed;
+  IdScratch scratch;
+  IdStrategy strategy;
+  uint32_t site; /**< Replica suffix of generated ids, SITE_NONE by default. */
+} PTree;
+
+void initPTree(PTree *t) {
+  t->root = NULL;
+  t->used = 0;
+  t->seed = 2463534242u;
+  initScratch(&t->scratch);
+  t->strategy = STRATEGY_BISECT;
+  t->site = SITE_NONE;
+}
+
+size_t ptreeCount(PTreeNode *n) {
+  return n == NULL ? 0 : n->count;
+}
+
+void ptreeUpdate(PTreeNode *n) {
+  n->count = 1 + ptreeCount(n->left) + ptreeCount(n->right);
+}
+
+PTreeNode *ptreeRetain(PTreeNode *n) {
+  if (n != NULL)
+    ++n->refs;
+  return n;
+}
+
+void ptreeRelease(PTreeNode *n) {
+  if (n == NULL || --n->refs > 0)
+    return;
+  ptreeRelease(n->left);
+  ptreeRelease(n->right);
+  InlineId_Free(NULL, &n->id);
+  free(n);
+}
+
+// Turns a reference to n into a reference to a node only the caller
+// points to: n itself if nobody else does, otherwise a copy sharing n's
+// children.
+PTreeNode *ptreeOwn(PTreeNode *n) {
+  if (n->refs == 1)
+    return n;
+  PTreeNode *c = malloc(sizeof(PTreeNode));
+  *c = *n;
+  c->id = InlineId_FromByteArray(NULL, InlineId_View(&n->id));
+  c->refs = 1;
+  ptreeRetain(c->left);
+  ptreeRetain(c->right);
+  --n->refs;
+  return c;
+}
+
+// Split and merge consume the references they are given and hand back
+// owned ones, copying only the nodes they change.
+void ptreeSplit(PTreeNode *n, size_t k, PTreeNode **l, PTreeNode **r) {
+  if (n == NULL){
+    *l = *r = NULL;
+    return;
+  }
+  n = ptreeOwn(n);
+  if (ptreeCount(n->left) < k){
+    ptreeSplit(n->right, k - ptreeCount(n->left) - 1, &n->right, r);
+    *l = n;
+  }
+  else{
+    ptreeSplit(n->left, k, l, &n->left);
+    *r = n;
+  }
+  ptreeUpdate(n);
+}
+
+PTreeNode *ptreeMerge(PTreeNode *l, PTreeNode *r) {
+  if (l == NULL)
+    return r;
+  if (r == NULL)
+    return l;
+  if (l->prio > r->prio){
+    l = ptreeOwn(l);
+    l->right = ptreeMerge(l->right, r);
+    ptreeUpdate(l);
+    return l;
+  }
+  r = ptreeOwn(r);
+  r->left = ptreeMerge(l, r->left);
+  ptreeUpdate(r);
+  return r;
+}
+
+// O(1): dst starts as the same document as src, and the two diverge only
+// as they are edited.
+void snapshotPTree(PTree *dst, PTree *src) {
+  *dst = *src;
+  ptreeRetain(dst->root);
+  initScratch(&dst->scratch);
+}
+
+InlineId *getPTreeAt(PTree *t, int pos) {
+  PTreeNode *n = t->root;
+  size_t k = pos;
+  while (n != NULL){
+    size_t lc = ptreeCount(n->left);
+    if (k < lc)
+      n = n->left;
+    else if (k == lc)
+      return &n->id;
+    else{
+      k -= lc+1;
+      n = n->right;
+    }
+  }
+  return NULL;
+}
+
+ByteArray GeneratePTreeIdViewAt(PTree *t, int pos) {
+  InlineId *left = pos > 0 ? getPTreeAt(t, pos-1) : NULL;
+  InlineId *right = pos < t->used ? getPTreeAt(t, pos) : NULL;
+  return GenerateIdViewBetween(&t->scratch, left, right, t->strategy, t->site);
+}
+
+void insertPTreeAt(PTree *t, int pos) {
+  if (pos <= t->used) {
+    PTreeNode *n = malloc(sizeof(PTreeNode));
+    n->id = InlineId_FromByteArray(NULL, GeneratePTreeIdViewAt(t, pos));
+    n->left = n->right = NULL;
+    t->seed ^= t->seed << 13;
+    t->seed ^= t->seed >> 17;
+    t->seed ^= t->seed << 5;
+    n->prio = t->seed;
+    n->refs = 1;
+    n->count = 1;
+    PTreeNode *l, *r;
+    ptreeSplit(t->root, pos, &l, &r);
+    t->root = ptreeMerge(ptreeMerge(l, n), r);
+    ++t->used;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+// The id is freed once no other version holds it.
+void deletePTreeAt(PTree *t, int pos) {
+  if (pos < t->used) {
+    PTreeNode *l, *m, *r;
+    ptreeSplit(t->root, pos, &l, &r);
+    ptreeSplit(r, 1, &m, &r);
+    ptreeRelease(m);
+    t->root = ptreeMerge(l, r);
+    --t->used;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+void printPTreeNode(PTreeNode *n) {
+  if (n == NULL)
+    return;
+  printPTreeNode(n->left);
+  printByteArray(InlineId_View(&n->id));
+  printPTreeNode(n->right);
+}
+
+void printPTree(PTree *t) {
+  printPTreeNode(t->root);
+}
+
+// Drops this version; nodes still shared with other versions survive.
+void freePTree(PTree *t) {
+  ptreeRelease(t->root);
+  t->root = NULL;
+  t->used = 0;
+  freeScratch(&t->scratch);
+}
+
+///// end of Persistent sequence
+
+///// Id index as prefix-compressed B+-tree
+
+// Leaves are page-sized and store their first id in full and every other
+// id as (shared prefix with the first id, suffix), lengths as varints.
+// Neighbouring ids share most of their bytes, so a leaf holds a few
+// hundred of them. Inner nodes route on separator ids.
+
+#define INDEX_PAGE 512
+#define INDEX_FANOUT 64
+
+typedef struct _IndexLeaf {
+  uint32_t count; /**< Number of ids in the leaf. */
+  uint32_t used; /**< Bytes of `data` in use. */
+  uint32_t cap; /**< Bytes available in `data`; only exceeds the page for very long ids. */
+  uint8_t data[]; /**< Encoded ids. */
+} IndexLeaf;
+
+typedef struct _IndexInner {
+  int count; /**< Number of children. */
+  InlineId keys[INDEX_FANOUT]; /**< keys[i] is the smallest id under children[i]; keys[0] is unused. */
+  void *children[INDEX_FANOUT];
+} IndexInner;
+
+typedef struct {
+  void *root;
+  int height; /**< 0 when the root is a leaf. */
+  size_t count; /**< Number of ids in the index. */
+  IdScratch scratch; /**< Leaves are decoded here. */
+} IdIndex;
+
+size_t varintLen(size_t v){
+  size_t n = 1;
+  while (v >= N128){
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+size_t putVarint(uint8_t *out, size_t v){
+  size_t n = 0;
+  while (v >= N128){
+    out[n++] = (v & N127) | N128;
+    v >>= 7;
+  }
+  out[n++] = v;
+  return n;
+}
+
+size_t getVarint(const uint8_t *in, size_t *v){
+  size_t n = 0;
+  int shift = 0;
+  *v = 0;
+  do {
+    *v |= (size_t)(in[n] & N127) << shift;
+    shift += 7;
+  } while (in[n++] >= N128);
+  return n;
+}
+
+IndexLeaf *newLeaf(size_t cap){
+  cap = MAX(cap, INDEX_PAGE - sizeof(IndexLeaf));
+  IndexLeaf *leaf = malloc(sizeof(IndexLeaf) + cap);
+  leaf->count = 0;
+  leaf->used = 0;
+  leaf->cap = cap;
+  return leaf;
+}
+
+size_t leafEncodedSize(ByteArray *keys, int n){
+  if (n == 0)
+    return 0;
+  size_t size = varintLen(keys[0].len) + keys[0].len;
+  for (int i = 1; i < n; ++i){
+    size_t shared = firstDifference(keys[0].data, keys[i].data, MIN(keys[0].len, keys[i].len));
+    size_t suffix = keys[i].len - shared;
+    size += varintLen(shared) + varintLen(suffix) + suffix;
+  }
+  return size;
+}
+
+void leafEncode(IndexLeaf *leaf, ByteArray *keys, int n){
+  size_t k = 0;
+  if (n > 0){
+    k += putVarint(leaf->data, keys[0].len);
+    memcpy(leaf->data + k, keys[0].data, keys[0].len);
+    k += keys[0].len;
+  }
+  for (int i = 1; i < n; ++i){
+    size_t shared = firstDifference(keys[0].data, keys[i].data, MIN(keys[0].len, keys[i].len));
+    size_t suffix = keys[i].len - shared;
+    k += putVarint(leaf->data + k, shared);
+    k += putVarint(leaf->data + k, suffix);
+    memcpy(leaf->data + k, keys[i].data + shared, suffix);
+    k += suffix;
+  }
+  leaf->count = n;
+  leaf->used = k;
+}
+
+// Materializes the ids of a leaf in the scratch, leaving room for `extra`
+// more entries in the returned array.
+int leafDecode(IdIndex *idx, IndexLeaf *leaf, int extra, ByteArray **keysOut){
+  size_t firstLen = 0;
+  if (leaf->count > 0)
+    getVarint(leaf->data, &firstLen);
+  size_t keysSize = (leaf->count + extra) * sizeof(ByteArray);
+  uint8_t *buf = scratchReserve(&idx->scratch, keysSize + leaf->count * firstLen + leaf->used);
+  ByteArray *keys = (ByteArray *)buf;
+  uint8_t *bytes = buf + keysSize;
+  size_t k = 0;
+  for (int i = 0; i < leaf->count; ++i){
+    size_t shared = 0, suffix;
+    if (i == 0)
+      k += getVarint(leaf->data, &suffix);
+    else{
+      k += getVarint(leaf->data + k, &shared);
+      k += getVarint(leaf->data + k, &suffix);
+    }
+    keys[i].data = bytes;
+    keys[i].len = shared + suffix;
+    memcpy(bytes, keys[0].data, shared);
+    memcpy(bytes + shared, leaf->data + k, suffix);
+    bytes += keys[i].len;
+    k += suffix;
+  }
+  *keysOut = keys;
+  return leaf->count;
+}
+
+int lowerBoundKeys(ByteArray *keys, int n, ByteArray id){
+  int lo = 0, hi = n;
+  while (lo < hi){
+    int mid = lo + (hi-lo)/2;
+    if (ByteArray_CompareCompressed(keys[mid], id) < 0)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Child of an inner node whose range holds id.
+int innerChild(IndexInner *in, ByteArray id){
+  int lo = 1, hi = in->count;
+  while (lo < hi){
+    int mid = lo + (hi-lo)/2;
+    if (ByteArray_CompareCompressed(InlineId_View(&in->keys[mid]), id) <= 0)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  return lo-1;
+}
+
+void initIdIndex(IdIndex *idx){
+  idx->root = newLeaf(0);
+  idx->height = 0;
+  idx->count = 0;
+  initScratch(&idx->scratch);
+}
+
+// Re-encodes keys into the leaf at *slot, growing it if a long id no longer
+// fits in a page.
+void leafStore(IndexLeaf **slot, ByteArray *keys, int n){
+  size_t size = leafEncodedSize(keys, n);
+  if (size > (*slot)->cap){
+    *slot = realloc(*slot, sizeof(IndexLeaf) + size);
+    (*slot)->cap = size;
+  }
+  leafEncode(*slot, keys, n);
+}
+
+// Inserts id below *slot. When the node splits, returns the new right
+// sibling and stores its smallest id in *sep.
+void *indexInsert(IdIndex *idx, void **slot, int height, ByteArray id, int *inserted, InlineId *sep){
+  if (height == 0){
+    IndexLeaf *leaf = *slot;
+    ByteArray *keys;
+    int n = leafDecode(idx, leaf, 1, &keys);
+    int pos = lowerBoundKeys(keys, n, id);
+    if (pos < n && ByteArray_CompareCompressed(keys[pos], id) == 0){
+      *inserted = 0;
+      return NULL;
+    }
+    *inserted = 1;
+    memmove(keys+pos+1, keys+pos, (n-pos) * sizeof(ByteArray));
+    keys[pos] = id;
+    n++;
+    if (n == 1 || leafEncodedSize(keys, n) <= leaf->cap){
+      leafStore((IndexLeaf **)slot, keys, n);
+      return NULL;
+    }
+    // appends keep the left leaf full, anything else splits evenly
+    int split = pos == n-1 ? n-1 : n/2;
+    IndexLeaf *right = newLeaf(leafEncodedSize(keys+split, n-split));
+    leafEncode(right, keys+split, n-split);
+    *sep = InlineId_FromByteArray(NULL, keys[split]);
+    leafStore((IndexLeaf **)slot, keys, split);
+    return right;
+  }
+
+  IndexInner *in = *slot;
+  int c = innerChild(in, id);
+  InlineId childSep;
+  void *child = indexInsert(idx, &in->children[c], height-1, id, inserted, &childSep);
+  if (child == NULL)
+    return NULL;
+  if (in->count < INDEX_FANOUT){
+    memmove(in->keys+c+2, in->keys+c+1, (in->count-c-1) * sizeof(InlineId));
+    memmove(in->children+c+2, in->children+c+1, (in->count-c-1) * sizeof(void *));
+    in->keys[c+1] = childSep;
+    in->children[c+1] = child;
+    in->count++;
+    return NULL;
+  }
+  InlineId keys[INDEX_FANOUT+1];
+  void *children[INDEX_FANOUT+1];
+  memcpy(keys, in->keys, (c+1) * sizeof(InlineId));
+  memcpy(children, in->children, (c+1) * sizeof(void *));
+  keys[c+1] = childSep;
+  children[c+1] = child;
+  memcpy(keys+c+2, in->keys+c+1, (in->count-c-1) * sizeof(InlineId));
+  memcpy(children+c+2, in->children+c+1, (in->count-c-1) * sizeof(void *));
+  int half = (INDEX_FANOUT+1)/2;
+  IndexInner *right = malloc(sizeof(IndexInner));
+  in->count = half;
+  memcpy(in->keys, keys, half * sizeof(InlineId));
+  memcpy(in->children, children, half * sizeof(void *));
+  right->count = INDEX_FANOUT+1-half;
+  memcpy(right->keys, keys+half, right->count * sizeof(InlineId));
+  memcpy(right->children, children+half, right->count * sizeof(void *));
+  *sep = right->keys[0];
+  right->keys[0].len = 0;
+  return right;
+}
+
+// Adds a compressed id; returns 0 if it was already present.
+int insertIdIndex(IdIndex *idx, ByteArray id){
+  int inserted;
+  InlineId sep;
+  void *right = indexInsert(idx, &idx->root, idx->height, id, &inserted, &sep);
+  if (right != NULL){
+    IndexInner *root = malloc(sizeof(IndexInner));
+    root->count = 2;
+    root->keys[0].len = 0;
+    root->keys[1] = sep;
+    root->children[0] = idx->root;
+    root->children[1] = right;
+    idx->root = root;
+    idx->height++;
+  }
+  idx->count += inserted;
+  return inserted;
+}
+
+void **indexLeafSlot(IdIndex *idx, ByteArray id){
+  void **slot = &idx->root;
+  for (int h = idx->height; h > 0; --h){
+    IndexInner *in = *slot;
+    slot = &in->children[innerChild(in, id)];
+  }
+  return slot;
+}
+
+// Lookups rebuild one id at a time and stop at the first one not below id,
+// instead of decoding the whole leaf.
+int containsIdIndex(IdIndex *idx, ByteArray id){
+  IndexLeaf *leaf = *indexLeafSlot(idx, id);
+  if (leaf->count == 0)
+    return 0;
+  ByteArray first, key;
+  size_t k = getVarint(leaf->data, &first.len);
+  first.data = leaf->data + k;
+  k += first.len;
+  key.data = scratchReserve(&idx->scratch, first.len + leaf->used);
+  memcpy(key.data, first.data, first.len);
+  key.len = first.len;
+  for (int i = 0; ; ){
+    int c = ByteArray_CompareCompressed(key, id);
+    if (c >= 0)
+      return c == 0;
+    if (++i == leaf->count)
+      return 0;
+    size_t shared, suffix;
+    k += getVarint(leaf->data + k, &shared);
+    k += getVarint(leaf->data + k, &suffix);
+    // shared prefixes are with the first key, not the previous one
+    memcpy(key.data, first.data, shared);
+    memcpy(key.data + shared, leaf->data + k, suffix);
+    key.len = shared + suffix;
+    k += suffix;
+  }
+}
+
+// Leaves may empty out; they are not merged, separators stay valid bounds.
+int removeIdIndex(IdIndex *idx, ByteArray id){
+  void **slot = indexLeafSlot(idx, id);
+  ByteArray *keys;
+  int n = leafDecode(idx, *slot, 0, &keys);
+  int pos = lowerBoundKeys(keys, n, id);
+  if (pos == n || ByteArray_CompareCompressed(keys[pos], id) != 0)
+    return 0;
+  memmove(keys+pos, keys+pos+1, (n-pos-1) * sizeof(ByteArray));
+  leafStore((IndexLeaf **)slot, keys, n-1);
+  idx->count--;
+  return 1;
+}
+
+void forEachIndexNode(IdIndex *idx, void *node, int height, void (*fn)(ByteArray, void *), void *ctx){
+  if (height == 0){
+    ByteArray *keys;
+    int n = leafDecode(idx, node, 0, &keys);
+    for (int i = 0; i < n; ++i)
+      fn(keys[i], ctx);
+    return;
+  }
+  IndexInner *in = node;
+  for (int i = 0; i < in->count; ++i)
+    forEachIndexNode(idx, in->children[i], height-1, fn, ctx);
+}
+
+// Calls fn on every id in order; fn must not modify the index.
+void forEachIdIndex(IdIndex *idx, void (*fn)(ByteArray, void *), void *ctx){
+  forEachIndexNode(idx, idx->root, idx->height, fn, ctx);
+}
+
+size_t indexNodeBytes(void *node, int height){
+  if (height == 0)
+    return sizeof(IndexLeaf) + ((IndexLeaf *)node)->cap;
+  IndexInner *in = node;
+  size_t bytes = sizeof(IndexInner);
+  for (int i = 0; i < in->count; ++i){
+    if (i > 0 && !InlineId_IsInline(&in->keys[i]))
+      bytes += in->keys[i].len;
+    bytes += indexNodeBytes(in->children[i], height-1);
+  }
+  return bytes;
+}
+
+// Heap footprint of the index, for comparison with an Array's.
+size_t bytesIdIndex(IdIndex *idx){
+  return indexNodeBytes(idx->root, idx->height);
+}
+
+void freeIndexNode(void *node, int height){
+  if (height > 0){
+    IndexInner *in = node;
+    for (int i = 0; i < in->count; ++i){
+      if (i > 0)
+        InlineId_Free(NULL, &in->keys[i]);
+      freeIndexNode(in->children[i], height-1);
+    }
+  }
+  free(node);
+}
+
+void freeIdIndex(IdIndex *idx){
+  freeIndexNode(idx->root, idx->height);
+  idx->root = NULL;
+  idx->count = 0;
+  freeScratch(&idx->scratch);
+}
+
+///// end of Id index
+
+///// Sequence implemented as unrolled list
+
+// A doubly linked list of chunks, each holding a run of consecutive ids
+// packed back to back as (varint length, compressed bytes). An edit moves
+// at most one chunk's bytes, a full chunk splits in two and a sparse one
+// merges into its successor, and walking the sequence reads memory in
+// order. A finger remembers the chunk of the last edit, so nearby edits
+// find their chunk in a step or two.
+
+#define CHUNK_BYTES 1024
+
+typedef struct _IdChunk {
+  struct _IdChunk *prev;
+  struct _IdChunk *next;
+  size_t count; /**< Ids in the chunk. */
+  size_t bytes; /**< Bytes of `data` in use. */
+  size_t cap; /**< CHUNK_BYTES, more only for an id that does not fit. */
+  uint8_t *data;
+} IdChunk;
+
+typedef struct {
+  IdChunk *head; /**< Never NULL: an empty list has one empty chunk. */
+  IdChunk *tail;
+  size_t used;
+  IdChunk *finger; /**< Chunk of the last edit. */
+  size_t fingerStart; /**< Position of the first id of `finger`. */
+  IdScratch scratch;
+  IdStrategy strategy;
+  uint32_t site; /**< Replica suffix of generated ids, SITE_NONE by default. */
+} ChunkList;
+
+IdChunk *newIdChunk(size_t cap) {
+  IdChunk *c = malloc(sizeof(IdChunk));
+  c->prev = c->next = NULL;
+  c->count = c->bytes = 0;
+  c->cap = MAX(cap, CHUNK_BYTES);
+  c->data = malloc(c->cap);
+  return c;
+}
+
+void freeIdChunk(IdChunk *c) {
+  free(c->data);
+  free(c);
+}
+
+void initChunkList(ChunkList *l) {
+  l->head = l->tail = l->finger = newIdChunk(CHUNK_BYTES);
+  l->used = l->fingerStart = 0;
+  initScratch(&l->scratch);
+  l->strategy = STRATEGY_BISECT;
+  l->site = SITE_NONE;
+}
+
+void linkIdChunkAfter(ChunkList *l, IdChunk *c, IdChunk *n) {
+  n->prev = c;
+  n->next = c->next;
+  if (c->next != NULL)
+    c->next->prev = n;
+  else
+    l->tail = n;
+  c->next = n;
+}
+
+void unlinkIdChunk(ChunkList *l, IdChunk *c) {
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else
+    l->head = c->next;
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+  else
+    l->tail = c->prev;
+  freeIdChunk(c);
+}
+
+// Id at byte offset `off` of c, returning the offset of the next one.
+size_t chunkIdAt(IdChunk *c, size_t off, ByteArray *id) {
+  off += getVarint(c->data + off, &id->len);
+  id->data = c->data + off;
+  return off + id->len;
+}
+
+// Byte offset of the k-th id of c; k == c->count gives c->bytes.
+size_t chunkOffset(IdChunk *c, size_t k) {
+  size_t off = 0;
+  ByteArray id;
+  while (k-- > 0)
+    off = chunkIdAt(c, off, &id);
+  return off;
+}
+
+ByteArray chunkLastId(IdChunk *c) {
+  ByteArray id;
+  chunkIdAt(c, chunkOffset(c, c->count-1), &id);
+  return id;
+}
+
+// Chunk holding position pos (at its end for pos == its start + count),
+// walking from the finger, or from the end of the list nearer to pos.
+IdChunk *locateChunk(ChunkList *l, size_t pos, size_t *start) {
+  IdChunk *c = l->finger;
+  size_t s = l->fingerStart;
+  if (pos < s && pos < s - pos){
+    c = l->head;
+    s = 0;
+  }
+  else if (pos > s + c->count && l->used - pos < pos - s){
+    c = l->tail;
+    s = l->used - c->count;
+  }
+  while (pos < s){
+    c = c->prev;
+    s -= c->count;
+  }
+  while (pos > s + c->count){
+    s += c->count;
+    c = c->next;
+  }
+  *start = s;
+  return c;
+}
+
+// View of the id at pos, valid until the next edit.
+ByteArray getChunkListAt(ChunkList *l, int pos) {
+  ByteArray none = {0, NULL};
+  if (pos < 0 || pos >= l->used)
+    return none;
+  size_t s;
+  IdChunk *c = locateChunk(l, pos, &s);
+  if (pos - s == c->count){
+    s += c->count;
+    c = c->next;
+  }
+  ByteArray id;
+  chunkIdAt(c, chunkOffset(c, pos - s), &id);
+  l->finger = c;
+  l->fingerStart = s;
+  return id;
+}
+
+// Moves the ids from the k-th on into a new chunk after c.
+IdChunk *splitIdChunk(ChunkList *l, IdChunk *c, size_t k) {
+  size_t off = chunkOffset(c, k);
+  IdChunk *n = newIdChunk(c->bytes - off);
+  memcpy(n->data, c->data + off, c->bytes - off);
+  n->bytes = c->bytes - off;
+  n->count = c->count - k;
+  c->bytes = off;
+  c->count = k;
+  linkIdChunkAfter(l, c, n);
+  return n;
+}
+
+// Appends c->next to c when both fit in one chunk.
+void maybeMergeIdChunk(ChunkList *l, IdChunk *c) {
+  IdChunk *n = c->next;
+  if (n == NULL || c->bytes + n->bytes > c->cap * 3/4)
+    return;
+  memcpy(c->data + c->bytes, n->data, n->bytes);
+  c->bytes += n->bytes;
+  c->count += n->count;
+  unlinkIdChunk(l, n);
+}
+
+// Stores the compressed id as the k-th of c, at byte offset `off`,
+// splitting c if it is full.
+void putChunkId(ChunkList *l, IdChunk *c, size_t s, size_t k, size_t off, ByteArray id) {
+  size_t need = varintLen(id.len) + id.len;
+  if (c->bytes + need > c->cap && c->count > 0){
+    IdChunk *n = splitIdChunk(l, c, c->count / 2);
+    if (k > c->count){
+      k -= c->count;
+      s += c->count;
+      off -= c->bytes;
+      c = n;
+    }
+  }
+  if (c->bytes + need > c->cap){
+    c->cap = c->bytes + need;
+    c->data = realloc(c->data, c->cap);
+  }
+  memmove(c->data + off + need, c->data + off, c->bytes - off);
+  off += putVarint(c->data + off, id.len);
+  memcpy(c->data + off, id.data, id.len);
+  c->bytes += need;
+  c->count++;
+  l->used++;
+  l->finger = c;
+  l->fingerStart = s;
+}
+
+// The ids around the k-th slot of c, reaching into the neighbouring
+// chunks at its edges, in one scan. Returns the byte offset of slot k.
+size_t chunkNeighbours(IdChunk *c, size_t k, ByteArray *left, ByteArray *right) {
+  ByteArray bal = {1, &BottomByte};
+  ByteArray bar = {1, &TopByte};
+  *left = bal;
+  *right = bar;
+  if (k == 0 && c->prev != NULL)
+    *left = chunkLastId(c->prev);
+  size_t off = 0;
+  for (size_t i = 0; i < k; ++i)
+    off = chunkIdAt(c, off, left);
+  if (k < c->count)
+    chunkIdAt(c, off, right);
+  else if (c->next != NULL)
+    chunkIdAt(c->next, 0, right);
+  return off;
+}
+
+void insertChunkListAt(ChunkList *l, int pos) {
+  if (pos <= l->used) {
+    size_t s;
+    IdChunk *c = locateChunk(l, pos, &s);
+    ByteArray bal, bar;
+    size_t off = chunkNeighbours(c, pos - s, &bal, &bar);
+    // generated into the scratch, so the chunks are free to move after
+    ByteArray id = ByteArray_GenerateBetweenSite(&l->scratch, bal, bar, l->strategy, l->site, Compression);
+    putChunkId(l, c, s, pos - s, off, id);
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+void deleteChunkListAt(ChunkList *l, int pos) {
+  if (pos < l->used) {
+    size_t s;
+    IdChunk *c = locateChunk(l, pos, &s);
+    if (pos - s == c->count){
+      s += c->count;
+      c = c->next;
+    }
+    size_t off = chunkOffset(c, pos - s);
+    ByteArray id;
+    size_t end = chunkIdAt(c, off, &id);
+    memmove(c->data + off, c->data + end, c->bytes - end);
+    c->bytes -= end - off;
+    c->count--;
+    l->used--;
+    if (c->count == 0 && l->head != l->tail){
+      IdChunk *p = c->prev;
+      unlinkIdChunk(l, c);
+      c = p != NULL ? p : l->head;
+      s = p != NULL ? s - p->count : 0;
+    }
+    else if (c->bytes < c->cap / 4){
+      if (c->prev != NULL && c->prev->bytes + c->bytes <= c->prev->cap * 3/4){
+        c = c->prev;
+        s -= c->count;
+      }
+      maybeMergeIdChunk(l, c);
+    }
+    l->finger = c;
+    l->fingerStart = s;
+  }
+  else
+    printf("Position is out of bounds\n");
+}
+
+// Copies the ids of `a`, filling chunks to three quarters.
+void initChunkListFromArray(ChunkList *l, Array *a) {
+  initChunkList(l);
+  IdChunk *c = l->head;
+  for (size_t i = 0; i < a->used; ++i){
+    ByteArray id = InlineId_View(&a->ba[i]);
+    if (c->count > 0 && c->bytes + varintLen(id.len) + id.len > CHUNK_BYTES * 3/4){
+      linkIdChunkAfter(l, c, newIdChunk(CHUNK_BYTES));
+      c = c->next;
+    }
+    putChunkId(l, c, l->used - c->count, c->count, c->bytes, id);
+  }
+  l->finger = l->head;
+  l->fingerStart = 0;
+  l->strategy = a->strategy;
+  l->site = a->site;
+}
+
+void forEachChunkList(ChunkList *l, void (*fn)(ByteArray, void *), void *ctx) {
+  for (IdChunk *c = l->head; c != NULL; c = c->next)
+    for (size_t off = 0; off < c->bytes;){
+      ByteArray id;
+      off = chunkIdAt(c, off, &id);
+      fn(id, ctx);
+    }
+}
+
+void printChunkId(ByteArray id, void *ctx) {
+  (void)ctx;
+  printByteArray(id);
+}
+
+void printChunkList(ChunkList *l) {
+  forEachChunkList(l, printChunkId, NULL);
+}
+
+void freeChunkList(ChunkList *l) {
+  while (l->head != NULL){
+    IdChunk *n = l->head->next;
+    freeIdChunk(l->head);
+    l->head = n;
+  }
+  l->tail = l->finger = NULL;
+  l->used = 0;
+  freeScratch(&l->scratch);
+}
+
+///// end of Seq as Unrolled List
+
+///// Concurrent sequence as lazy skip list
+
+// Keyed by id instead of position, so replicas need no shared index: every
+// thread owns a SkipReplica (site, level rng, scratch) and inserts after an
+// id it already knows. Writers lock only the nodes they relink and readers
+// never lock (Herlihy, Lev, Luchangco, Shavit: "A Simple Optimistic
+// Skiplist Algorithm"). Unlinked nodes are retired and freed by freeSkipList.
+
+#define SKIP_MAX_LEVEL 24
+
+typedef struct _SkipNode {
+  InlineId id; /**< Compressed id, allocated on the C heap. */
+  int topLevel;
+  atomic_int marked; /**< Logically deleted. */
+  atomic_int fullyLinked; /**< Linked on every level up to `topLevel`. */
+  pthread_mutex_t lock;
+  struct _SkipNode *retired; /**< Next node on the list of unlinked nodes. */
+  _Atomic(struct _SkipNode *) next[]; /**< `topLevel`+1 forward pointers. */
+} SkipNode;
+
+typedef struct {
+  SkipNode *head; /**< Bottom sentinel. */
+  SkipNode *tail; /**< Top sentinel. */
+  atomic_size_t used;
+  pthread_mutex_t retiredLock;
+  SkipNode *retired;
+} SkipList;
+
+typedef struct {
+  SkipList *list;
+  uint32_t site;
+  uint32_t seed; /**< xorshift state for node levels. */
+  IdStrategy strategy;
+  IdScratch scratch;
+} SkipReplica;
+
+SkipNode *newSkipNode(ByteArray id, int topLevel){
+  SkipNode *n = malloc(sizeof(SkipNode) + (topLevel+1) * sizeof(n->next[0]));
+  n->id = InlineId_FromByteArray(NULL, id);
+  n->topLevel = topLevel;
+  atomic_init(&n->marked, 0);
+  atomic_init(&n->fullyLinked, 0);
+  pthread_mutex_init(&n->lock, NULL);
+  n->retired = NULL;
+  for (int level = 0; level <= topLevel; ++level)
+    atomic_init(&n->next[level], NULL);
+  return n;
+}
+
+void freeSkipNode(SkipNode *n){
+  InlineId_Free(NULL, &n->id);
+  pthread_mutex_destroy(&n->lock);
+  free(n);
+}
+
+void initSkipList(SkipList *l){
+  ByteArray bottom = {1, &BottomByte};
+  ByteArray top = {1, &TopByte};
+  l->head = newSkipNode(bottom, SKIP_MAX_LEVEL-1);
+  l->tail = newSkipNode(top, SKIP_MAX_LEVEL-1);
+  for (int level = 0; level < SKIP_MAX_LEVEL; ++level)
+    atomic_init(&l->head->next[level], l->tail);
+  atomic_init(&l->head->fullyLinked, 1);
+  atomic_init(&l->tail->fullyLinked, 1);
+  atomic_init(&l->used, 0);
+  pthread_mutex_init(&l->retiredLock, NULL);
+  l->retired = NULL;
+}
+
+void initSkipReplica(SkipReplica *r, SkipList *l, uint32_t site){
+  assert(site <= SITE_MAX);
+  r->list = l;
+  r->site = site;
+  r->seed = (site + 1) * 2654435761u;
+  r->strategy = STRATEGY_BISECT;
+  initScratch(&r->scratch);
+}
+
+void freeSkipReplica(SkipReplica *r){
+  freeScratch(&r->scratch);
+}
+
+int skipRandomLevel(SkipReplica *r){
+  r->seed ^= r->seed << 13;
+  r->seed ^= r->seed >> 17;
+  r->seed ^= r->seed << 5;
+  int level = 0;
+  for (uint32_t x = r->seed; (x & 1) && level < SKIP_MAX_LEVEL-1; x >>= 1)
+    level++;
+  return level;
+}
+
+// Sentinels sort outside every id.
+int skipCompare(SkipList *l, SkipNode *n, ByteArray id){
+  if (n == l->head)
+    return -1;
+  if (n == l->tail)
+    return 1;
+  return ByteArray_CompareCompressed(InlineId_View(&n->id), id);
+}
+
+// Fills the last node below `id` and the first one not below it on every
+// level, and returns the highest level holding `id` or -1.
+int skipFind(SkipList *l, ByteArray id, SkipNode **preds, SkipNode **succs){
+  int found = -1;
+  SkipNode *pred = l->head;
+  for (int level = SKIP_MAX_LEVEL-1; level >= 0; --level){
+    SkipNode *curr = atomic_load(&pred->next[level]);
+    int c;
+    while ((c = skipCompare(l, curr, id)) < 0){
+      pred = curr;
+      curr = atomic_load(&pred->next[level]);
+    }
+    if (found == -1 && c == 0)
+      found = level;
+    preds[level] = pred;
+    succs[level] = curr;
+  }
+  return found;
+}
+
+// Locks the distinct predecessors of levels 0..`topLevel`, bottom up, and
+// checks they still point to `succs` and are alive. Returns the highest
+// level locked in `highest`.
+int skipLockPreds(SkipNode **preds, SkipNode **succs, int topLevel, int checkSucc, int *highest){
+  int valid = 1;
+  SkipNode *prev = NULL;
+  *highest = -1;
+  for (int level = 0; valid && level <= topLevel; ++level){
+    SkipNode *pred = preds[level], *succ = succs[level];
+    if (pred != prev){
+      pthread_mutex_lock(&pred->lock);
+      prev = pred;
+    }
+    *highest = level;
+    valid = !atomic_load(&pred->marked) && atomic_load(&pred->next[level]) == succ && (!checkSucc || !atomic_load(&succ->marked));
+  }
+  return valid;
+}
+
+void skipUnlockPreds(SkipNode **preds, int highest){
+  SkipNode *prev = NULL;
+  for (int level = 0; level <= highest; ++level)
+    if (preds[level] != prev){
+      pthread_mutex_unlock(&preds[level]->lock);
+      prev = preds[level];
+    }
+}
+
+// Links a node holding `id`, returns NULL when the id is already present.
+SkipNode *addSkipList(SkipList *l, ByteArray id, int topLevel){
+  SkipNode *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+  SkipNode *n = newSkipNode(id, topLevel);
+  for (;;){
+    int found = skipFind(l, id, preds, succs);
+    if (found != -1){
+      SkipNode *other = succs[found];
+      if (!atomic_load(&other->marked)){
+        while (!atomic_load(&other->fullyLinked))
+          ;
+        freeSkipNode(n);
+        return NULL;
+      }
+      continue; // being removed, wait for it to be unlinked
+    }
+    int highest;
+    if (!skipLockPreds(preds, succs, topLevel, 1, &highest)){
+      skipUnlockPreds(preds, highest);
+      continue;
+    }
+    for (int level = 0; level <= topLevel; ++level)
+      atomic_store(&n->next[level], succs[level]);
+    for (int level = 0; level <= topLevel; ++level)
+      atomic_store(&preds[level]->next[level], n);
+    atomic_store(&n->fullyLinked, 1);
+    skipUnlockPreds(preds, highest);
+    atomic_fetch_add(&l->used, 1);
+    return n;
+  }
+}
+
+int removeSkipList(SkipList *l, ByteArray id){
+  SkipNode *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+  SkipNode *victim = NULL;
+  for (;;){
+    int found = skipFind(l, id, preds, succs);
+    if (victim == NULL){
+      if (found == -1)
+        return 0;
+      SkipNode *n = succs[found];
+      if (!atomic_load(&n->fullyLinked) || n->topLevel != found || atomic_load(&n->marked))
+        return 0;
+      pthread_mutex_lock(&n->lock);
+      if (atomic_load(&n->marked)){
+        pthread_mutex_unlock(&n->lock);
+        return 0;
+      }
+      // logically deleted from here on, only this thread unlinks it
+      atomic_store(&n->marked, 1);
+      victim = n;
+    }
+    for (int level = 0; level <= victim->topLevel; ++level)
+      succs[level] = victim;
+    int highest;
+    if (!skipLockPreds(preds, succs, victim->topLevel, 0, &highest)){
+      skipUnlockPreds(preds, highest);
+      continue;
+    }
+    for (int level = victim->topLevel; level >= 0; --level)
+      atomic_store(&preds[level]->next[level], atomic_load(&victim->next[level]));
+    pthread_mutex_unlock(&victim->lock);
+    skipUnlockPreds(preds, highest);
+    atomic_fetch_sub(&l->used, 1);
+    // concurrent readers may still be standing on it
+    pthread_mutex_lock(&l->retiredLock);
+    victim->retired = l->retired;
+    l->retired = victim;
+    pthread_mutex_unlock(&l->retiredLock);
+    return 1;
+  }
+}
+
+int containsSkipList(SkipList *l, ByteArray id){
+  SkipNode *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+  int found = skipFind(l, id, preds, succs);
+  return found != -1 && atomic_load(&succs[found]->fullyLinked) && !atomic_load(&succs[found]->marked);
+}
+
+// Inserts a new id of the replica's site right after `left`, which is a
+// stored id or the bottom sentinel. Concurrent inserts after the same id
+// all succeed, in site order. The returned bytes live until freeSkipList.
+ByteArray insertSkipListAfter(SkipReplica *r, ByteArray left){
+  SkipList *l = r->list;
+  SkipNode *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+  for (;;){
+    skipFind(l, left, preds, succs);
+    SkipNode *right = succs[0];
+    if (skipCompare(l, right, left) == 0)
+      right = atomic_load(&right->next[0]);
+    ByteArray id = ByteArray_GenerateBetweenSite(&r->scratch, left, InlineId_View(&right->id), r->strategy, r->site, Compression);
+    SkipNode *n = addSkipList(l, id, skipRandomLevel(r));
+    if (n != NULL)
+      return InlineId_View(&n->id);
+  }
+}
+
+// Not safe against concurrent writers.
+void forEachSkipList(SkipList *l, void (*fn)(ByteArray, void *), void *ctx){
+  for (SkipNode *n = atomic_load(&l->head->next[0]); n != l->tail; n = atomic_load(&n->next[0]))
+    fn(InlineId_View(&n->id), ctx);
+}
+
+void freeSkipList(SkipList *l){
+  SkipNode *n = l->head;
+  while (n != NULL){
+    SkipNode *next = n == l->tail ? NULL : atomic_load(&n->next[0]);
+    freeSkipNode(n);
+    n = next;
+  }
+  while (l->retired != NULL){
+    n = l->retired;
+    l->retired = n->retired;
+    freeSkipNode(n);
+  }
+  pthread_mutex_destroy(&l->retiredLock);
+}
+
+///// end of Seq as Skip List
+
+///// Lock-free skip list
+
+// Readers are never blocked: links are CAS'd and a node is deleted by
+// setting the low bit of its next pointers (top level down, level 0 last
+// decides the winner), after which any traversal snips it (Fraser,
+// "Practical lock-freedom"). Memory is reclaimed with epochs: a thread
+// pins the global epoch while it touches the list, and nodes it retires
+// are freed once the epoch has moved on twice.
+
+typedef struct _LfNode {
+  InlineId id; /**< Compressed id, allocated on the C heap. */
+  int topLevel;
+  atomic_int refs; /**< Held by the inserter while linking and by the remover, the last one retires. */
+  struct _LfNode *limbo; /**< Next retired node of the same epoch. */
+  _Atomic uintptr_t next[]; /**< Successor pointers, the low bit marks this node deleted. */
+} LfNode;
+
+typedef struct _EpochRecord {
+  atomic_uint epoch; /**< Global epoch seen when entering. */
+  atomic_int active; /**< Inside a critical section. */
+  unsigned seen; /**< Epoch at which `limbo` was last collected. */
+  LfNode *limbo[3]; /**< Retired nodes by epoch modulo 3. */
+  size_t retired; /**< Retired since the last attempt to advance. */
+  struct _EpochRecord *next;
+} EpochRecord;
+
+typedef struct {
+  LfNode *head;
+  LfNode *tail;
+  atomic_size_t used;
+  atomic_uint epoch;
+  _Atomic(EpochRecord *) records; /**< Every registered thread, never shrinks. */
+} LfSkipList;
+
+typedef struct {
+  LfSkipList *list;
+  EpochRecord *record;
+  uint32_t seed; /**< xorshift state for node levels. */
+} LfHandle;
+
+#define LF_MARK ((uintptr_t)1)
+#define LF_NODE(p) ((LfNode *)((p) & ~LF_MARK))
+#define LF_ADVANCE_EVERY 64
+
+LfNode *newLfNode(ByteArray id, int topLevel){
+  LfNode *n = malloc(sizeof(LfNode) + (topLevel+1) * sizeof(n->next[0]));
+  n->id = InlineId_FromByteArray(NULL, id);
+  n->topLevel = topLevel;
+  atomic_init(&n->refs, 2);
+  n->limbo = NULL;
+  for (int level = 0; level <= topLevel; ++level)
+    atomic_init(&n->next[level], 0);
+  return n;
+}
+
+void freeLfNode(LfNode *n){
+  InlineId_Free(NULL, &n->id);
+  free(n);
+}
+
+void initLfSkipList(LfSkipList *l){
+  ByteArray bottom = {1, &BottomByte};
+  ByteArray top = {1, &TopByte};
+  l->head = newLfNode(bottom, SKIP_MAX_LEVEL-1);
+  l->tail = newLfNode(top, SKIP_MAX_LEVEL-1);
+  for (int level = 0; level < SKIP_MAX_LEVEL; ++level)
+    atomic_init(&l->head->next[level], (uintptr_t)l->tail);
+  atomic_init(&l->used, 0);
+  atomic_init(&l->epoch, 0);
+  atomic_init(&l->records, NULL);
+}
+
+// Registers the calling thread. Handles are not shared between threads.
+void initLfHandle(LfHandle *h, LfSkipList *l, uint32_t seed){
+  EpochRecord *r = malloc(sizeof(EpochRecord));
+  atomic_init(&r->epoch, 0);
+  atomic_init(&r->active, 0);
+  r->seen = 0;
+  r->limbo[0] = r->limbo[1] = r->limbo[2] = NULL;
+  r->retired = 0;
+  r->next = atomic_load(&l->records);
+  while (!atomic_compare_exchange_weak(&l->records, &r->next, r))
+    ;
+  h->list = l;
+  h->record = r;
+  h->seed = seed | 1;
+}
+
+void freeLimbo(LfNode *n){
+  while (n != NULL){
+    LfNode *next = n->limbo;
+    freeLfNode(n);
+    n = next;
+  }
+}
+
+void lfEnter(LfHandle *h){
+  EpochRecord *r = h->record;
+  atomic_store(&r->active, 1);
+  unsigned e = atomic_load(&h->list->epoch);
+  atomic_store(&r->epoch, e);
+  if (e != r->seen){
+    // retired at e-3 or before: every thread has left that epoch
+    freeLimbo(r->limbo[e % 3]);
+    r->limbo[e % 3] = NULL;
+    r->seen = e;
+  }
+}
+
+void lfTryAdvance(LfSkipList *l){
+  unsigned e = atomic_load(&l->epoch);
+  for (EpochRecord *r = atomic_load(&l->records); r != NULL; r = r->next)
+    if (atomic_load(&r->active) && atomic_load(&r->epoch) != e)
+      return;
+  atomic_compare_exchange_strong(&l->epoch, &e, e+1);
+}
+
+void lfExit(LfHandle *h){
+  EpochRecord *r = h->record;
+  atomic_store(&r->active, 0);
+  if (r->retired >= LF_ADVANCE_EVERY){
+    r->retired = 0;
+    lfTryAdvance(h->list);
+  }
+}
+
+void lfRelease(LfHandle *h, LfNode *n){
+  if (atomic_fetch_sub(&n->refs, 1) == 1){
+    EpochRecord *r = h->record;
+    unsigned e = atomic_load(&r->epoch);
+    n->limbo = r->limbo[e % 3];
+    r->limbo[e % 3] = n;
+    r->retired++;
+  }
+}
+
+int lfCompare(LfSkipList *l, LfNode *n, ByteArray id){
+  if (n == l->head)
+    return -1;
+  if (n == l->tail)
+    return 1;
+  return ByteArray_CompareCompressed(InlineId_View(&n->id), id);
+}
+
+// Like skipFind, snipping the deleted nodes it walks over. Returns whether
+// level 0 holds `id`.
+int lfFind(LfSkipList *l, ByteArray id, LfNode **preds, LfNode **succs){
+retry:;
+  LfNode *pred = l->head;
+  int c = 1;
+  for (int level = SKIP_MAX_LEVEL-1; level >= 0; --level){
+    LfNode *curr = LF_NODE(atomic_load(&pred->next[level]));
+    for (;;){
+      uintptr_t succ = atomic_load(&curr->next[level]);
+      while (succ & LF_MARK){
+        uintptr_t expected = (uintptr_t)curr;
+        if (!atomic_compare_exchange_strong(&pred->next[level], &expected, succ & ~LF_MARK))
+          goto retry;
+        curr = LF_NODE(succ);
+        succ = atomic_load(&curr->next[level]);
+      }
+      if ((c = lfCompare(l, curr, id)) >= 0)
+        break;
+      pred = curr;
+      curr = LF_NODE(succ);
+    }
+    preds[level] = pred;
+    succs[level] = curr;
+  }
+  return c == 0;
+}
+
+// Inserts an id, returns 0 when it is already present.
+int insertLfSkipList(LfHandle *h, ByteArray id){
+  LfSkipList *l = h->list;
+  LfNode *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+  h->seed ^= h->seed << 13;
+  h->seed ^= h->seed >> 17;
+  h->seed ^= h->seed << 5;
+  int topLevel = 0;
+  for (uint32_t x = h->seed; (x & 1) && topLevel < SKIP_MAX_LEVEL-1; x >>= 1)
+    topLevel++;
+  LfNode *n = newLfNode(id, topLevel);
+  lfEnter(h);
+  for (;;){
+    if (lfFind(l, id, preds, succs)){
+      lfExit(h);
+      freeLfNode(n);
+      return 0;
+    }
+    for (int level = 0; level <= topLevel; ++level)
+      atomic_store(&n->next[level], (uintptr_t)succs[level]);
+    uintptr_t expected = (uintptr_t)succs[0];
+    if (atomic_compare_exchange_strong(&preds[0]->next[0], &expected, (uintptr_t)n))
+      break;
+  }
+  atomic_fetch_add(&l->used, 1);
+  // from here on it is in the list, the upper levels are only shortcuts
+  for (int level = 1; level <= topLevel; ++level)
+    for (;;){
+      uintptr_t next = atomic_load(&n->next[level]);
+      if (next & LF_MARK)
+        goto linked; // removed meanwhile
+      if (LF_NODE(next) != succs[level] && !atomic_compare_exchange_strong(&n->next[level], &next, (uintptr_t)succs[level]))
+        continue;
+      uintptr_t expected = (uintptr_t)succs[level];
+      if (atomic_compare_exchange_strong(&preds[level]->next[level], &expected, (uintptr_t)n))
+        break;
+      lfFind(l, id, preds, succs);
+      if (succs[0] != n)
+        goto linked;
+    }
+linked:
+  // a remover may have finished before the last levels were linked
+  if (atomic_load(&n->next[0]) & LF_MARK)
+    lfFind(l, id, preds, succs);
+  lfRelease(h, n);
+  lfExit(h);
+  return 1;
+}
+
+int removeLfSkipList(LfHandle *h, ByteArray id){
+  LfSkipList *l = h->list;
+  LfNode *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+  lfEnter(h);
+  if (!lfFind(l, id, preds, succs)){
+    lfExit(h);
+    return 0;
+  }
+  LfNode *n = succs[0];
+  for (int level = n->topLevel; level > 0; --level)
+    atomic_fetch_or(&n->next[level], LF_MARK);
+  uintptr_t next = atomic_load(&n->next[0]);
+  for (;;){
+    if (next & LF_MARK){ // another thread won
+      lfExit(h);
+      return 0;
+    }
+    if (atomic_compare_exchange_weak(&n->next[0], &next, next | LF_MARK))
+      break;
+  }
+  atomic_fetch_sub(&l->used, 1);
+  lfFind(l, id, preds, succs);
+  lfRelease(h, n);
+  lfExit(h);
+  return 1;
+}
+
+int containsLfSkipList(LfHandle *h, ByteArray id){
+  LfSkipList *l = h->list;
+  LfNode *pred = l->head, *curr = NULL;
+  lfEnter(h);
+  for (int level = SKIP_MAX_LEVEL-1; level >= 0; --level){
+    curr = LF_NODE(atomic_load(&pred->next[level]));
+    while (lfCompare(l, curr, id) < 0){
+      pred = curr;
+      curr = LF_NODE(atomic_load(&curr->next[level]));
+    }
+  }
+  int found = lfCompare(l, curr, id) == 0 && !(atomic_load(&curr->next[0]) & LF_MARK);
+  lfExit(h);
+  return found;
+}
+
+// In-order walk of level 0 that never retries or writes, skipping deleted
+// nodes. Safe alongside writers.
+void forEachLfSkipList(LfHandle *h, void (*fn)(ByteArray, void *), void *ctx){
+  LfSkipList *l = h->list;
+  lfEnter(h);
+  LfNode *n = LF_NODE(atomic_load(&l->head->next[0]));
+  while (n != l->tail){
+    uintptr_t next = atomic_load(&n->next[0]);
+    if (!(next & LF_MARK))
+      fn(InlineId_View(&n->id), ctx);
+    n = LF_NODE(next);
+  }
+  lfExit(h);
+}
+
+// Once every thread is done with the list.
+void freeLfSkipList(LfSkipList *l){
+  LfNode *n = l->head;
+  while (n != l->tail){
+    LfNode *next = LF_NODE(atomic_load(&n->next[0]));
+    freeLfNode(n);
+    n = next;
+  }
+  freeLfNode(l->tail);
+  EpochRecord *r = atomic_load(&l->records);
+  while (r != NULL){
+    EpochRecord *next = r->next;
+    for (int i = 0; i < 3; ++i)
+      freeLimbo(r->limbo[i]);
+    free(r);
+    r = next;
+  }
+}
+
+///// end of Lock-free skip list
+
+///// Serialization
+
+// A sequence on disk is the magic "IDGS" followed, for every id in order,
+// by the number of bytes it shares with the previous id and the number of
+// bytes that follow, as varints, then those bytes. Ids are kept in their
+// compressed form. The pair (0, 0) ends the stream: ids are never empty.
+
+#define SERIAL_MAGIC "IDGS"
+#define SERIAL_MAX_ID (1u << 24) /**< Longer ids are taken for corruption. */
+
+typedef struct {
+  FILE *f;
+  uint8_t *prev; /**< Previous id, whose prefix the next one shares. */
+  size_t prevLen;
+  size_t cap;
+  size_t count; /**< Ids written so far. */
+} IdWriter;
+
+typedef struct {
+  FILE *f;
+  uint8_t *cur; /**< Last id read, valid until the next readId. */
+  size_t len;
+  size_t cap;
+} IdReader;
+
+int initIdWriter(IdWriter *w, FILE *f){
+  w->f = f;
+  w->prev = NULL;
+  w->prevLen = w->cap = w->count = 0;
+  return fwrite(SERIAL_MAGIC, 1, 4, f) == 4 ? 0 : -1;
+}
+
+int writeId(IdWriter *w, ByteArray id){
+  assert(id.len > 0);
+  size_t shared = firstDifference(w->prev, id.data, MIN(w->prevLen, id.len));
+  if (shared == id.len) // never in a sequence, keep one byte to stay apart from the end marker
+    shared--;
+  uint8_t head[20];
+  size_t n = putVarint(head, shared);
+  n += putVarint(head+n, id.len-shared);
+  if (fwrite(head, 1, n, w->f) != n || fwrite(id.data+shared, 1, id.len-shared, w->f) != id.len-shared)
+    return -1;
+  if (w->cap < id.len){
+    w->cap = MAX(id.len, 2*w->cap);
+    w->prev = realloc(w->prev, w->cap);
+  }
+  memcpy(w->prev+shared, id.data+shared, id.len-shared);
+  w->prevLen = id.len;
+  w->count++;
+  return 0;
+}
+
+// Writes the end marker and releases the writer, the file stays open.
+int finishIdWriter(IdWriter *w){
+  uint8_t end[2] = {0, 0};
+  int res = fwrite(end, 1, 2, w->f) == 2 && fflush(w->f) == 0 ? 0 : -1;
+  free(w->prev);
+  w->prev = NULL;
+  return res;
+}
+
+int initIdReader(IdReader *r, FILE *f){
+  char magic[4];
+  r->f = f;
+  r->cur = NULL;
+  r->len = r->cap = 0;
+  if (fread(magic, 1, 4, f) != 4 || memcmp(magic, SERIAL_MAGIC, 4) != 0)
+    return -1;
+  return 0;
+}
+
+int readVarint(FILE *f, size_t *v){
+  int shift = 0, c;
+  *v = 0;
+  do {
+    if ((c = getc(f)) == EOF || shift > 63)
+      return -1;
+    *v |= (size_t)(c & N127) << shift;
+    shift += 7;
+  } while (c >= N128);
+  return 0;
+}
+
+// 1 with the next id in `id`, 0 at the end marker, -1 if the stream is
+// truncated or malformed.
+int readId(IdReader *r, ByteArray *id){
+  size_t shared, rest;
+  if (readVarint(r->f, &shared) || readVarint(r->f, &rest))
+    return -1;
+  if (shared == 0 && rest == 0)
+    return 0;
+  if (shared > r->len || rest == 0 || rest > SERIAL_MAX_ID - shared)
+    return -1;
+  if (r->cap < shared+rest){
+    size_t cap = MAX(shared+rest, 2*r->cap);
+    uint8_t *cur = realloc(r->cur, cap);
+    if (cur == NULL)
+      return -1;
+    r->cur = cur;
+    r->cap = cap;
+  }
+  if (fread(r->cur+shared, 1, rest, r->f) != rest)
+    return -1;
+  r->len = shared+rest;
+  id->len = r->len;
+  id->data = r->cur;
+  return 1;
+}
+
+void freeIdReader(IdReader *r){
+  free(r->cur);
+  r->cur = NULL;
+}
+
+int saveArray(Array *a, FILE *f){
+  IdWriter w;
+  int res = initIdWriter(&w, f);
+  for (int i = 0; res == 0 && i < a->used; ++i)
+    res = writeId(&w, InlineId_View(&a->ba[i]));
+  if (res == 0)
+    return finishIdWriter(&w);
+  free(w.prev);
+  return res;
+}
+
+// Appends the ids of a saved sequence, returns how many or -1.
+long loadArray(Array *a, FILE *f){
+  IdReader r;
+  ByteArray id;
+  long count = 0;
+  int res = initIdReader(&r, f);
+  while (res == 0 && (res = readId(&r, &id)) == 1){
+    if (a->used == a->size){
+      a->size = MAX(2*a->size, 16);
+      a->ba = realloc(a->ba, a->size * sizeof(InlineId));
+    }
+    a->ba[a->used++] = InlineId_FromByteArray(a->arena, id);
+    count++;
+    res = 0;
+  }
+  freeIdReader(&r);
+  return res == 0 ? count : -1;
+}
+
+///// end of Serialization
+
+///// Memory-mapped snapshot
+
+// A snapshot is the magic "IDGM", a format version and the number of ids
+// n, followed by n+1 uint64 offsets and the compressed ids packed back to
+// back; id i spans [offsets[i], offsets[i+1]) of the packed bytes.
+// Integers are in host byte order. Opening maps the file read-only and
+// every query reads straight from the mapping.
+
+#define SNAPSHOT_MAGIC "IDGM"
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t count;
+} SnapshotHeader;
+
+typedef struct {
+  uint8_t *map;
+  size_t mapLen;
+  size_t count;
+  const uint64_t *offsets; /**< `count`+1 entries into `bytes`. */
+  uint8_t *bytes;
+} Snapshot;
+
+int writeSnapshot(Array *a, const char *path){
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+    return -1;
+  SnapshotHeader h = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, a->used};
+  int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+  uint64_t off = 0;
+  for (int i = 0; ok && i <= a->used; ++i){
+    ok = fwrite(&off, sizeof(off), 1, f) == 1;
+    if (i < a->used)
+      off += a->ba[i].len;
+  }
+  for (int i = 0; ok && i < a->used; ++i)
+    ok = fwrite(InlineId_Data(&a->ba[i]), 1, a->ba[i].len, f) == a->ba[i].len;
+  return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+int openSnapshot(Snapshot *s, const char *path){
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(SnapshotHeader)){
+    close(fd);
+    return -1;
+  }
+  s->mapLen = st.st_size;
+  s->map = mmap(NULL, s->mapLen, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (s->map == MAP_FAILED)
+    return -1;
+  const SnapshotHeader *h = (const SnapshotHeader *)s->map;
+  size_t room = (s->mapLen - sizeof(SnapshotHeader)) / sizeof(uint64_t);
+  if (memcmp(h->magic, SNAPSHOT_MAGIC, 4) != 0 || h->version != SNAPSHOT_VERSION || h->count >= room){
+    munmap(s->map, s->mapLen);
+    return -1;
+  }
+  s->count = h->count;
+  s->offsets = (const uint64_t *)(s->map + sizeof(SnapshotHeader));
+  s->bytes = s->map + sizeof(SnapshotHeader) + (s->count+1) * sizeof(uint64_t);
+  // every id has to be non-empty and lie within the packed bytes, in
+  // order, so queries never read outside the mapping
+  size_t packed = s->mapLen - (s->bytes - s->map);
+  for (size_t i = 0; i < s->count; ++i)
+    if (s->offsets[i] >= s->offsets[i+1]){
+      munmap(s->map, s->mapLen);
+      return -1;
+    }
+  if (s->offsets[0] != 0 || s->offsets[s->count] > packed){
+    munmap(s->map, s->mapLen);
+    return -1;
+  }
+  return 0;
+}
+
+void closeSnapshot(Snapshot *s){
+  munmap(s->map, s->mapLen);
+  s->map = NULL;
+}
+
+ByteArray snapshotId(Snapshot *s, size_t i){
+  ByteArray id = {s->offsets[i+1] - s->offsets[i], s->bytes + s->offsets[i]};
+  return id;
+}
+
+size_t lowerBoundSnapshot(Snapshot *s, ByteArray id){
+  size_t lo = 0, hi = s->count;
+  while (lo < hi){
+    size_t mid = lo + (hi-lo)/2;
+    if (ByteArray_CompareCompressed(snapshotId(s, mid), id) < 0)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Position of the compressed `id`, or -1 if it is not in the snapshot.
+long indexOfSnapshot(Snapshot *s, ByteArray id){
+  size_t pos = lowerBoundSnapshot(s, id);
+  if (pos < s->count && ByteArray_CompareCompressed(snapshotId(s, pos), id) == 0)
+    return pos;
+  return -1;
+}
+
+void forEachSnapshot(Snapshot *s, void (*fn)(ByteArray, void *), void *ctx){
+  for (size_t i = 0; i < s->count; ++i)
+    fn(snapshotId(s, i), ctx);
+}
+
+// Id for an insert at `pos` between the mapped neighbours, living in
+// `scratch`.
+ByteArray GenerateSnapshotIdViewAt(Snapshot *s, IdScratch *scratch, size_t pos, IdStrategy strategy, uint32_t site){
+  ByteArray left = {1, &BottomByte};
+  ByteArray right = {1, &TopByte};
+  if (pos > 0)
+    left = snapshotId(s, pos-1);
+  if (pos < s->count)
+    right = snapshotId(s, pos);
+  return ByteArray_GenerateBetweenSite(scratch, left, right, strategy, site, Compression);
+}
+
+///// end of Memory-mapped snapshot
+
+///// Op log replay
+
+// An op log is a stream of varints, one per operation: the position
+// shifted left once, the low bit set for deletes. Replay reads it in
+// chunks and folds runs of ops into one array operation: inserts at
+// pos, pos+1, ... (typing) become one insertArrayAtN, deletes repeated at
+// pos (forward delete) or at pos, pos-1, ... (backspace) become one
+// deleteArrayRange. Batched inserts get evenly spread ids instead of the
+// ones per-op replay would generate; the order is the same.
+
+#define OPLOG_CHUNK 65536
+
+typedef struct {
+  size_t ops;
+  size_t inserts;
+  size_t deletes;
+  size_t batches; /**< Array operations actually applied. */
+  double seconds;
+} ReplayStats;
+
+typedef struct {
+  int isDelete;
+  size_t start;
+  size_t n; /**< 0 when nothing is pending. */
+} ReplayBatch;
+
+int putOp(FILE *f, int isDelete, size_t pos){
+  uint8_t buf[10];
+  size_t n = putVarint(buf, pos << 1 | (isDelete != 0));
+  return fwrite(buf, 1, n, f) == n ? 0 : -1;
+}
+
+int flushReplayBatch(Array *a, ReplayBatch *b, ReplayStats *stats){
+  if (b->n == 0)
+    return 0;
+  if (b->isDelete ? b->start + b->n > a->used : b->start > a->used)
+    return -1;
+  if (b->isDelete)
+    deleteArrayRange(a, b->start, b->n);
+  else
+    insertArrayAtN(a, b->start, b->n);
+  stats->batches++;
+  b->n = 0;
+  return 0;
+}
+
+// Adds one op to the pending batch, flushing it first when the op does not
+// extend it.
+int addReplayOp(Array *a, ReplayBatch *b, int isDelete, size_t pos, ReplayStats *stats){
+  if (b->n > 0 && b->isDelete == isDelete){
+    if (!isDelete && pos == b->start + b->n){
+      b->n++;
+      return 0;
+    }
+    if (isDelete && pos == b->start){
+      b->n++;
+      return 0;
+    }
+    if (isDelete && pos+1 == b->start){
+      b->start--;
+      b->n++;
+      return 0;
+    }
+  }
+  if (flushReplayBatch(a, b, stats) != 0)
+    return -1;
+  b->isDelete = isDelete;
+  b->start = pos;
+  b->n = 1;
+  return 0;
+}
+
+// Applies every op of the log to `a`. Returns the number of ops, or -1 when
+// the log is truncated or unreadable or an op is out of bounds.
+long replayOpLog(Array *a, FILE *f, ReplayStats *stats){
+  uint8_t *buf = malloc(OPLOG_CHUNK);
+  size_t len = 0, off = 0;
+  int eof = 0, res = 0;
+  ReplayBatch b = {0, 0, 0};
+  ReplayStats local;
+  if (stats == NULL)
+    stats = &local;
+  memset(stats, 0, sizeof(*stats));
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (;;){
+    // keep a whole varint in the buffer
+    if (len - off < 10 && !eof){
+      memmove(buf, buf+off, len-off);
+      len -= off;
+      off = 0;
+      len += fread(buf+len, 1, OPLOG_CHUNK-len, f);
+      if (ferror(f)){
+        res = -1;
+        break;
+      }
+      eof = feof(f);
+    }
+    if (off == len)
+      break;
+    size_t v, n = 0;
+    while (off+n < len && buf[off+n] >= N128)
+      n++;
+    if (off+n == len || n > 9){
+      res = -1;
+      break;
+    }
+    off += getVarint(buf+off, &v);
+    if (addReplayOp(a, &b, v & 1, v >> 1, stats) != 0){
+      res = -1;
+      break;
+    }
+    stats->ops++;
+    if (v & 1)
+      stats->deletes++;
+    else
+      stats->inserts++;
+  }
+  if (res == 0)
+    res = flushReplayBatch(a, &b, stats);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  stats->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  free(buf);
+  return res == 0 ? (long)stats->ops : -1;
+}
+
+void printReplayStats(ReplayStats *stats){
+  printf("%zu ops (%zu inserts, %zu deletes) in %zu batches, %.3f s, %.0f ops/s\n",
+    stats->ops, stats->inserts, stats->deletes, stats->batches, stats->seconds, stats->ops / stats->seconds);
+}
+
+///// end of Op log replay
+
+#ifdef IDGEN_STATS
+
+///// Statistics
+
+static const char *StatOpNames[STAT_OPS] = {"generate", "compress", "decompress", "insert", "delete"};
+
+uint64_t latencyBucketLow(size_t idx){
+  if (idx < (1u << LATENCY_SUB_BITS))
+    return idx;
+  int e = (idx >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+  return (uint64_t)((1u << LATENCY_SUB_BITS) | (idx & ((1u << LATENCY_SUB_BITS) - 1))) << (e - LATENCY_SUB_BITS);
+}
+
+// Lower bound of the bucket holding quantile `q`, within 1/16.
+uint64_t latencyPercentile(LatencyHistogram *h, double q){
+  uint64_t rank = (uint64_t)(q * h->total), seen = 0;
+  for (size_t i = 0; i < LATENCY_BUCKETS; ++i){
+    seen += h->counts[i];
+    if (seen > rank)
+      return latencyBucketLow(i);
+  }
+  return h->max;
+}
+
+void resetIdStats(){
+  free(IdStats.lengths);
+  memset(&IdStats, 0, sizeof(IdStats));
+}
+
+void printIdStats(){
+  printf("branches: equal-prefix %llu, increment %llu, append %llu, above-tail %llu, new-digit %llu, divide %llu, increment-wide %llu, strategy %llu, spread %llu\n",
+    (unsigned long long)IdStats.genEqualPrefix, (unsigned long long)IdStats.genIncrement, (unsigned long long)IdStats.genAppend,
+    (unsigned long long)IdStats.genAboveTail, (unsigned long long)IdStats.genNewDigit, (unsigned long long)IdStats.genDivide,
+    (unsigned long long)IdStats.genIncrementWide, (unsigned long long)IdStats.genStrategy, (unsigned long long)IdStats.genSpread);
+  printf("allocations %llu (%llu bytes), compress reallocs %llu, decompress reallocs %llu, scratch growths %llu\n",
+    (unsigned long long)IdStats.allocations, (unsigned long long)IdStats.bytesAllocated, (unsigned long long)IdStats.compressReallocs,
+    (unsigned long long)IdStats.decompressReallocs, (unsigned long long)IdStats.scratchGrowths);
+  for (int op = 0; op < STAT_OPS; ++op){
+    LatencyHistogram *h = &IdStats.latency[op];
+    if (h->total > 0)
+      printf("%-10s %llu ops, p50 %llu ns, p90 %llu ns, p99 %llu ns, max %llu ns\n", StatOpNames[op], (unsigned long long)h->total,
+        (unsigned long long)latencyPercentile(h, 0.5), (unsigned long long)latencyPercentile(h, 0.9),
+        (unsigned long long)latencyPercentile(h, 0.99), (unsigned long long)h->max);
+  }
+}
+
+FILE *openStatsFile(const char *prefix, const char *name, const char *header){
+  char path[256];
+  snprintf(path, sizeof(path), "%s_%s.csv", prefix, name);
+  FILE *f = fopen(path, "w");
+  if (f != NULL)
+    fprintf(f, "%s\n", header);
+  return f;
+}
+
+// Writes <prefix>_counters.csv, <prefix>_lengths.csv and one
+// <prefix>_latency_<op>.csv per operation, label in the first column and
+// value in the second as histo.gnuplot reads them.
+int dumpIdStats(const char *prefix){
+  FILE *f = openStatsFile(prefix, "counters", "Counter,Count");
+  if (f == NULL)
+    return -1;
+  const char *names[] = {"equal_prefix", "increment", "append", "above_tail", "new_digit", "divide", "increment_wide", "strategy", "spread",
+    "allocations", "bytes_allocated", "compress_reallocs", "decompress_reallocs", "scratch_growths"};
+  uint64_t values[] = {IdStats.genEqualPrefix, IdStats.genIncrement, IdStats.genAppend, IdStats.genAboveTail, IdStats.genNewDigit,
+    IdStats.genDivide, IdStats.genIncrementWide, IdStats.genStrategy, IdStats.genSpread, IdStats.allocations, IdStats.bytesAllocated,
+    IdStats.compressReallocs, IdStats.decompressReallocs, IdStats.scratchGrowths};
+  for (int i = 0; i < sizeof(values)/sizeof(values[0]); ++i)
+    fprintf(f, "%s,%llu\n", names[i], (unsigned long long)values[i]);
+  fclose(f);
+
+  if ((f = openStatsFile(prefix, "lengths", "Bytes,Ids")) == NULL)
+    return -1;
+  for (size_t i = 0; i < IdStats.lengthsCap; ++i)
+    fprintf(f, "%zu,%llu\n", i+1, (unsigned long long)IdStats.lengths[i]);
+  fclose(f);
+
+  for (int op = 0; op < STAT_OPS; ++op){
+    char name[64], header[64];
+    snprintf(name, sizeof(name), "latency_%s", StatOpNames[op]);
+    snprintf(header, sizeof(header), "Nanoseconds,%s", StatOpNames[op]);
+    if ((f = openStatsFile(prefix, name, header)) == NULL)
+      return -1;
+    LatencyHistogram *h = &IdStats.latency[op];
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i)
+      if (h->counts[i] > 0)
+        fprintf(f, "%llu,%llu\n", (unsigned long long)latencyBucketLow(i), (unsigned long long)h->counts[i]);
+    fclose(f);
+  }
+  return 0;
+}
+
+// Something for `make stats` to measure: n random inserts, n/10 appends
+// (whose ids grow runs of 0x7f) and n/5 random deletes on an Array,
+// then a round trip of every id through both codecs.
+void runStatsWorkload(size_t n){
+  Array a;
+  initArray(&a, 16);
+  for (size_t i = 0; i < n; ++i)
+    insertArrayAt(&a, rand() % (a.used+1));
+  for (size_t i = 0; i < n/10; ++i)
+    insertArrayAt(&a, a.used);
+  for (size_t i = 0; i < n/5; ++i)
+    deleteArrayAt(&a, rand() % a.used);
+  for (size_t i = 0; i < a.used; ++i){
+    ByteArray raw = decompress(InlineId_View(&a.ba[i]));
+    ByteArray comp = compress(raw);
+    ByteArray legacy = compressLegacy(raw);
+    ByteArray legacyRaw = decompressLegacy(legacy);
+    free(raw.data);
+    free(comp.data);
+    free(legacy.data);
+    free(legacyRaw.data);
+  }
+  freeDocument(&a);
+}
+
+///// end of Statistics
+
+#endif
+
+///// unit tests
 
 void testDecompress(){
   ByteArray ba;
@@ -425,12 +4435,1229 @@ void testCompress(){
   printByteArray(decompress(compress(ba)));
 }
 
+void testCompareCompressed(){
+  ByteArray ba1;
+  ba1.len = 131;
+  ba1.data = malloc(ba1.len);
+  for (int i = 0; i < 130; ++i)
+    ba1.data[i] = 0x7f;
+  ba1.data[130] = 0x05;
+
+  ByteArray ba2;
+  ba2.len = 3;
+  ba2.data = malloc(ba2.len);
+  ba2.data[0] = 0x7f;
+  ba2.data[1] = 0x7f;
+  ba2.data[2] = 0x7f;
+
+  // 0x81 0x82 0x05 against 0x83: a longer run sorts higher despite its
+  // smaller leading count digit
+  ByteArray comp1 = compress(ba1), comp2 = compress(ba2);
+  printByteArray(comp1);
+  printByteArray(comp2);
+  printf("compare: %d, compressed: %d\n", compare(ba1, ba2), ByteArray_CompareCompressed(comp1, comp2));
+}
+
+void testCompareFast(){
+  uint8_t x[80], y[80];
+  for (int t = 0; t < 100000; ++t){
+    ByteArray a, b;
+    a.len = rand() % 80;
+    b.len = rand() % 80;
+    a.data = x;
+    b.data = y;
+    for (int i = 0; i < a.len; ++i)
+      x[i] = rand() % 4 + 0x7c;
+    // mostly shared prefixes so the difference lands at every offset
+    for (int i = 0; i < b.len; ++i)
+      y[i] = (i < a.len && rand() % 64) ? x[i] : rand() % 4 + 0x7c;
+    assert(compareFast(a, b) == compare(a, b));
+    assert(compareFast(b, a) == compare(b, a));
+  }
+  printf("compareFast matches compare\n");
+}
+
+// Inline, spilled, and longer than 16 bits of length.
+void testInlineIds(){
+  size_t lens[] = {1, ID_INLINE_CAP, ID_INLINE_CAP+1, 70000};
+  uint8_t *data = malloc(70000);
+  for (size_t i = 0; i < 70000; ++i)
+    data[i] = rand() % N127 + 1;
+  for (int i = 0; i < 4; ++i){
+    ByteArray ba = {lens[i], data};
+    InlineId id = InlineId_FromByteArray(NULL, ba);
+    ByteArray view = InlineId_View(&id);
+    assert(view.len == lens[i] && memcmp(view.data, data, lens[i]) == 0);
+    assert(InlineId_IsInline(&id) == (lens[i] <= ID_INLINE_CAP));
+    InlineId_Free(NULL, &id);
+  }
+  free(data);
+}
+
+void testTreeMatchesArray(){
+  Array a;
+  Tree t;
+  initArray(&a, 16);
+  initTree(&t);
+  for (int i = 0; i < 20000; ++i){
+    int pos = rand() % (a.used+1);
+    if (a.used > 0 && rand() % 4 == 0){
+      pos = rand() % a.used;
+      deleteArrayAt(&a, pos);
+      deleteTreeAt(&t, pos);
+    }
+    else{
+      insertArrayAt(&a, pos);
+      insertTreeAt(&t, pos);
+    }
+  }
+  assert(a.used == t.used);
+  for (int i = 0; i < a.used; ++i){
+    assert(InlineId_Compare(&a.ba[i], getTreeAt(&t, i)) == 0);
+    assert(indexOfTree(&t, InlineId_View(&a.ba[i])) == i);
+  }
+  printf("tree matches array on %zu ids\n", t.used);
+  freeDocument(&a);
+  freeTree(&t);
+}
+
+// Same edits on a heap array and on arena-backed copies; deleted ids go
+// back to the arena slabs and get reused by later inserts.
+void testArenaSequences(){
+  IdArena arrayArena, treeArena;
+  initArena(&arrayArena);
+  initArena(&treeArena);
+  Array a, b;
+  Tree t;
+  initArray(&a, 16);
+  initArrayWithArena(&b, 16, &arrayArena);
+  initTreeWithArena(&t, &treeArena);
+  for (int i = 0; i < 20000; ++i){
+    int pos = rand() % (a.used+1);
+    if (a.used > 0 && rand() % 4 == 0){
+      pos = rand() % a.used;
+      deleteArrayAt(&a, pos);
+      deleteArrayAt(&b, pos);
+      deleteTreeAt(&t, pos);
+    }
+    else{
+      insertArrayAt(&a, pos);
+      insertArrayAt(&b, pos);
+      insertTreeAt(&t, pos);
+    }
+  }
+  assert(a.used == b.used && a.used == t.used);
+  for (int i = 0; i < a.used; ++i){
+    assert(InlineId_Compare(&a.ba[i], &b.ba[i]) == 0);
+    assert(InlineId_Compare(&a.ba[i], getTreeAt(&t, i)) == 0);
+  }
+  printf("arena sequences match array on %zu ids\n", a.used);
+  freeDocument(&a);
+  freeDocument(&b);
+  freeTree(&t);
+  freeArena(&treeArena);
+}
+
+void testGapBufferMatchesArray(){
+  Array a;
+  GapBuffer g;
+  initArray(&a, 16);
+  initGapBuffer(&g, 1);
+  int pos = 0;
+  for (int i = 0; i < 20000; ++i){
+    // mostly close to the previous edit, sometimes anywhere
+    if (rand() % 10 == 0)
+      pos = rand() % (a.used+1);
+    else{
+      int near = pos + rand() % 9 - 4;
+      pos = MAX(0, MIN(near, (int)a.used));
+    }
+    if (a.used > 0 && rand() % 4 == 0){
+      pos = MIN(pos, (int)a.used-1);
+      deleteArrayRange(&a, pos, 1);
+      deleteGapBufferAt(&g, pos);
+    }
+    else{
+      insertArrayAt(&a, pos);
+      insertGapBufferAt(&g, pos);
+    }
+  }
+  assert(a.used == g.used);
+  for (int i = 0; i < a.used; ++i)
+    assert(InlineId_Compare(&a.ba[i], getGapBufferAt(&g, i)) == 0);
+  GapBuffer copy;
+  initGapBufferFromArray(&copy, &a);
+  for (int i = 0; i < a.used; ++i)
+    assert(InlineId_Compare(&a.ba[i], getGapBufferAt(&copy, i)) == 0);
+  printf("gap buffer matches array on %zu ids\n", g.used);
+  freeGapBuffer(&copy);
+  freeGapBuffer(&g);
+  freeDocument(&a);
+}
+
+// rank/select through the index against counting bit by bit, while bits
+// flip.
+void testPositionIndex(){
+  enum { WORDS = 1000 };
+  uint64_t bits[WORDS];
+  for (int w = 0; w < WORDS; ++w)
+    bits[w] = (uint64_t)rand() << 33 ^ (uint64_t)rand() << 11 ^ rand();
+  Fenwick f;
+  indexBitmap(&f, bits, WORDS);
+  for (int round = 0; round < 200; ++round){
+    for (int i = 0; i < 50; ++i){
+      size_t slot = rand() % (64 * WORDS);
+      int wasSet = bits[slot / 64] >> (slot % 64) & 1;
+      bits[slot / 64] ^= 1ull << (slot % 64);
+      fenwickAdd(&f, slot / RANK_BLOCK_BITS, wasSet ? -1 : 1);
+    }
+    size_t r = 0, probe = rand() % (64 * WORDS);
+    for (size_t slot = 0; slot < 64 * WORDS; ++slot){
+      if (slot == probe)
+        assert(bitmapRank(bits, &f, slot) == r);
+      if (bits[slot / 64] >> (slot % 64) & 1){
+        if (r % 97 == round % 97)
+          assert(bitmapSelect(bits, &f, r) == slot);
+        ++r;
+      }
+    }
+    assert(bitmapRank(bits, &f, 64 * WORDS) == r);
+  }
+  freeFenwick(&f);
+}
+
+void testLazyArrayMatchesArray(){
+  Array a;
+  LazyArray l;
+  initArray(&a, 16);
+  initLazyArray(&l, 16);
+  for (int i = 0; i < 40000; ++i){
+    int r = rand() % 100;
+    if (a.used > 0 && r < 20){
+      int pos = rand() % a.used;
+      deleteArrayAt(&a, pos);
+      deleteLazyArrayAt(&l, pos);
+    }
+    else if (a.used > 0 && r < 21){
+      // cut a block, now and then everything
+      int all = rand() % 200 == 0;
+      int pos = all ? 0 : rand() % a.used;
+      size_t n = all ? a.used : rand() % MIN(a.used - pos, 100) + 1;
+      deleteArrayRange(&a, pos, n);
+      deleteLazyArrayRange(&l, pos, n);
+    }
+    else{
+      int pos = rand() % (a.used+1);
+      insertArrayAt(&a, pos);
+      insertLazyArrayAt(&l, pos);
+    }
+    assert(a.used == l.used);
+    assert(l.a.used - l.used < LAZY_MIN_COMPACT || l.used >= l.a.used/2); // dead slots bounded
+  }
+  for (int i = 0; i < a.used; ++i){
+    assert(InlineId_Compare(&a.ba[i], getLazyArrayAt(&l, i)) == 0);
+    assert(indexOfLazyArray(&l, InlineId_View(&a.ba[i])) == i);
+  }
+  printf("lazy array matches array on %zu ids in %zu slots\n", l.used, l.a.used);
+  deleteLazyArrayRange(&l, 0, l.used);
+  assert(l.a.used < LAZY_MIN_COMPACT && l.a.size <= 2*LAZY_MIN_COMPACT);
+  freeLazyArray(&l);
+  freeDocument(&a);
+}
+
+void checkChunkOrder(ByteArray id, void *ctx){
+  Array *a = ctx;
+  assert(a->used < a->size && ByteArray_CompareCompressed(InlineId_View(&a->ba[a->used]), id) == 0);
+  a->used++;
+}
+
+// Mostly local edits with random jumps, then inserts that keep bisecting
+// the same gap until ids outgrow a chunk.
+void testChunkListMatchesArray(){
+  Array a;
+  ChunkList l;
+  initArray(&a, 16);
+  initChunkList(&l);
+  int pos = 0;
+  for (int i = 0; i < 66000; ++i){
+    if (rand() % 10 == 0)
+      pos = rand() % (a.used+1);
+    else{
+      int near = pos + rand() % 9 - 4;
+      pos = MAX(0, MIN(near, (int)a.used));
+    }
+    if (a.used > 0 && i < 58000 && rand() % 100 < (i < 40000 ? 30 : 70)){
+      pos = MIN(pos, (int)a.used-1);
+      deleteArrayAt(&a, pos);
+      deleteChunkListAt(&l, pos);
+    }
+    else if (i < 58000){
+      insertArrayAt(&a, pos);
+      insertChunkListAt(&l, pos);
+    }
+    else{
+      insertArrayAt(&a, 1);
+      insertChunkListAt(&l, 1);
+    }
+  }
+  assert(a.used == l.used);
+  size_t ids = 0, chunks = 0, longest = 0;
+  for (IdChunk *c = l.head; c != NULL; c = c->next){
+    assert(c->bytes <= c->cap && (c->count > 0 || l.head == l.tail));
+    assert(c->next == NULL ? l.tail == c : c->next->prev == c);
+    ids += c->count;
+    chunks++;
+  }
+  assert(ids == l.used);
+  for (int i = 0; i < a.used; ++i){
+    ByteArray id = getChunkListAt(&l, i);
+    assert(ByteArray_CompareCompressed(InlineId_View(&a.ba[i]), id) == 0);
+    longest = MAX(longest, id.len);
+  }
+  size_t used = a.used;
+  a.used = 0;
+  forEachChunkList(&l, checkChunkOrder, &a);
+  assert(a.used == used);
+  printf("chunk list matches array on %zu ids in %zu chunks, longest id %zu bytes\n", l.used, chunks, longest);
+  freeChunkList(&l);
+  freeDocument(&a);
+}
+
+void checkIndexOrder(ByteArray id, void *ctx){
+  Array *a = ctx;
+  assert(ByteArray_CompareCompressed(InlineId_View(&a->ba[a->used]), id) == 0);
+  a->used++;
+}
+
+void testIdIndex(){
+  Array a;
+  IdIndex idx;
+  initArray(&a, 1024);
+  initIdIndex(&idx);
+  for (int i = 0; i < 100000; ++i)
+    insertArrayAt(&a, rand() % (a.used+1));
+  // random order so leaves split in the middle as well as at the end
+  for (int i = 0; i < a.used; ++i)
+    insertIdIndex(&idx, InlineId_View(&a.ba[rand() % a.used]));
+  for (int i = 0; i < a.used; ++i)
+    insertIdIndex(&idx, InlineId_View(&a.ba[i]));
+  assert(idx.count == a.used);
+  for (int i = 0; i < a.used; ++i)
+    assert(containsIdIndex(&idx, InlineId_View(&a.ba[i])));
+  size_t used = a.used;
+  a.used = 0;
+  forEachIdIndex(&idx, checkIndexOrder, &a);
+  assert(a.used == used);
+  printf("index: %zu bytes, array: %zu bytes for %zu ids\n", bytesIdIndex(&idx), a.used * sizeof(InlineId), a.used);
+  for (int i = 0; i < a.used; i += 2)
+    assert(removeIdIndex(&idx, InlineId_View(&a.ba[i])));
+  for (int i = 0; i < a.used; ++i)
+    assert(containsIdIndex(&idx, InlineId_View(&a.ba[i])) == i % 2);
+  freeIdIndex(&idx);
+  freeDocument(&a);
+  // the third key shares more with the first than the second does
+  uint8_t k1[] = {0x05, 0x82, 0x10}, k2[] = {0x05, 0x83}, k3[] = {0x05, 0x82, 0x81, 0x01};
+  ByteArray keys[] = {{3, k1}, {2, k2}, {4, k3}};
+  initIdIndex(&idx);
+  for (int i = 0; i < 3; ++i)
+    assert(insertIdIndex(&idx, keys[i]));
+  for (int i = 0; i < 3; ++i){
+    assert(containsIdIndex(&idx, keys[i]));
+    assert(!insertIdIndex(&idx, keys[i]));
+  }
+  freeIdIndex(&idx);
+}
+
+void testGenerateNBetween(){
+  ByteArray ba1;
+  ba1.len = 2;
+  ba1.data = malloc(ba1.len);
+  ba1.data[0] = 0x01;
+  ba1.data[1] = 0x41;
+  ByteArray ba2;
+  ba2.len = 1;
+  ba2.data = malloc(ba2.len);
+  ba2.data[0] = 0x02;
+
+  size_t n = 100000;
+  ByteArray *ids = ByteArray_GenerateNBetween(ba1, ba2, n, 0);
+  assert(lessThan(ba1, ids[0]));
+  assert(lessThan(ids[n-1], ba2));
+  size_t maxLen = 0;
+  for (size_t i = 0; i < n; ++i){
+    if (i > 0)
+      assert(lessThan(ids[i-1], ids[i]));
+    maxLen = MAX(maxLen, ids[i].len);
+  }
+  for (size_t i = 0; i < n; ++i)
+    free(ids[i].data);
+  free(ids);
+  free(ba1.data);
+  free(ba2.data);
+  printf("%zu ids between, longest is %zu bytes\n", n, maxLen);
+
+  Array a;
+  initArray(&a, 4);
+  for (int i = 0; i < 100; ++i)
+    insertArrayAtN(&a, rand() % (a.used+1), rand() % 1000 + 1);
+  maxLen = 0;
+  for (int i = 1; i < a.used; ++i){
+    assert(InlineId_Compare(&a.ba[i-1], &a.ba[i]) < 0);
+    maxLen = MAX(maxLen, a.ba[i].len);
+  }
+  printf("%zu ids from 100 pastes, longest is %zu bytes\n", a.used, maxLen);
+  freeDocument(&a);
+}
+
+// Parallel imports, and parallel pastes into a document, give the very
+// ids of the sequential spread whatever the thread count.
+void testParallelImport(){
+  size_t sizes[] = {1, 5000, 100000, 1000003};
+  for (int i = 0; i < 4; ++i)
+    for (int threads = 1; threads <= 8; threads *= 2){
+      Array seq, par;
+      initArray(&seq, 16);
+      initArray(&par, 16);
+      insertArrayAtN(&seq, 0, sizes[i]);
+      insertArrayAtNParallel(&par, 0, sizes[i], threads);
+      for (int k = 0; k < 20; ++k){
+        int pos = rand() % (seq.used+1);
+        size_t n = rand() % 20000 + 1;
+        insertArrayAtN(&seq, pos, n);
+        insertArrayAtNParallel(&par, pos, n, threads);
+      }
+      assert(seq.used == par.used);
+      for (size_t j = 0; j < seq.used; ++j){
+        assert(InlineId_Compare(&seq.ba[j], &par.ba[j]) == 0);
+        assert(j == 0 || InlineId_Compare(&par.ba[j-1], &par.ba[j]) < 0);
+      }
+      freeDocument(&seq);
+      freeDocument(&par);
+    }
+  printf("parallel imports match the sequential spread\n");
+}
+
+void testStrategies(){
+  const char *names[] = {"bisect", "boundary+", "boundary-", "lseq", "exponential", "append"};
+  for (int st = STRATEGY_BISECT; st <= STRATEGY_APPEND; ++st){
+    Array appends, prepends;
+    initArray(&appends, 1024);
+    initArray(&prepends, 1024);
+    appends.strategy = prepends.strategy = st;
+    for (int i = 0; i < 5000; ++i){
+      insertArrayAt(&appends, appends.used);
+      insertArrayAt(&prepends, 0);
+    }
+    for (int i = 1; i < appends.used; ++i){
+      assert(InlineId_Compare(&appends.ba[i-1], &appends.ba[i]) < 0);
+      assert(InlineId_Compare(&prepends.ba[i-1], &prepends.ba[i]) < 0);
+    }
+    ByteArray last = InlineId_View(&appends.ba[appends.used-1]);
+    ByteArray first = InlineId_View(&prepends.ba[0]);
+    printf("%-12s appends: %zu/%zu bytes, prepends: %zu/%zu bytes (compressed/raw)\n", names[st],
+      last.len, decompressedLen(last), first.len, decompressedLen(first));
+    freeDocument(&appends);
+    freeDocument(&prepends);
+  }
+}
+
+void testSiteIds(){
+  // two replicas of one document inserting at the same positions
+  Array a, b;
+  initArray(&a, 16);
+  initArray(&b, 16);
+  insertArrayAtN(&a, 0, 100);
+  insertArrayAtN(&b, 0, 100);
+  a.site = 1;
+  b.site = 2;
+  for (int i = 0; i < 2000; ++i){
+    int pos = rand() % (a.used+1);
+    insertArrayAt(&a, pos);
+    insertArrayAt(&b, pos);
+    ByteArray x = InlineId_View(&a.ba[pos]), y = InlineId_View(&b.ba[pos]);
+    assert(ByteArray_CompareCompressed(x, y) < 0);
+    ByteArray raw = decompress(x);
+    assert(getSiteDigits(raw.data + raw.len - SITE_DIGITS) == 1);
+    free(raw.data);
+  }
+  // combined, the replicas share only the 100 ids from before the split:
+  // none of the concurrent ones collide
+  size_t k = 0;
+  ByteArray *batch = malloc(b.used * sizeof(ByteArray));
+  for (int i = 0; i < b.used; ++i)
+    batch[k++] = InlineId_View(&b.ba[i]);
+  qsort(batch, k, sizeof(ByteArray), ByteArray_CompareCompressedPtr);
+  assert(mergeArray(&a, batch, k) == 2000);
+  assert(a.used == 100 + 2*2000);
+  for (int i = 1; i < a.used; ++i)
+    assert(InlineId_Compare(&a.ba[i-1], &a.ba[i]) < 0);
+  free(batch);
+  freeDocument(&a);
+  freeDocument(&b);
+}
+
+typedef struct {
+  SkipList *list;
+  uint32_t site;
+  int ops;
+} SkipWorker;
+
+void *skipWorker(void *arg){
+  SkipWorker *w = arg;
+  SkipReplica r;
+  initSkipReplica(&r, w->list, w->site);
+  ByteArray bottom = {1, &BottomByte};
+  ByteArray *mine = malloc(w->ops * sizeof(ByteArray));
+  int n = 0;
+  for (int i = 0; i < w->ops; ++i){
+    uint32_t x = skipRandomLevel(&r) ^ r.seed;
+    if (n > 0 && x % 8 == 0){ // remove one of ours
+      int k = x % n;
+      assert(removeSkipList(w->list, mine[k]));
+      mine[k] = mine[--n];
+    }
+    else{
+      ByteArray left = n == 0 || x % 16 == 1 ? bottom : mine[x % n];
+      mine[n++] = insertSkipListAfter(&r, left);
+    }
+  }
+  free(mine);
+  freeSkipReplica(&r);
+  return NULL;
+}
+
+typedef struct {
+  ByteArray prev;
+  size_t count;
+} SkipCheck;
+
+void checkSkipOrder(ByteArray id, void *ctx){
+  SkipCheck *c = ctx;
+  if (c->count > 0)
+    assert(ByteArray_CompareCompressed(c->prev, id) < 0);
+  c->prev = id;
+  c->count++;
+}
+
+void testConcurrentSkipList(){
+  int total = 400000;
+  for (int threads = 1; threads <= 8; threads *= 2){
+    SkipList l;
+    initSkipList(&l);
+    pthread_t tid[8];
+    SkipWorker w[8];
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; ++i){
+      w[i] = (SkipWorker){&l, i, total / threads};
+      pthread_create(&tid[i], NULL, skipWorker, &w[i]);
+    }
+    for (int i = 0; i < threads; ++i)
+      pthread_join(tid[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    SkipCheck c = {{0, NULL}, 0};
+    forEachSkipList(&l, checkSkipOrder, &c);
+    assert(c.count == atomic_load(&l.used));
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%d threads: %zu ids, %.0f ops/s\n", threads, c.count, total / secs);
+    freeSkipList(&l);
+  }
+}
+
+typedef struct {
+  LfSkipList *list;
+  uint32_t site;
+  int ops;
+  size_t live; /**< Ids this thread left in the list. */
+  atomic_int *done;
+} LfWorker;
+
+void *lfWriter(void *arg){
+  LfWorker *w = arg;
+  LfHandle h;
+  initLfHandle(&h, w->list, w->site + 1);
+  // ids come from a private document whose site keeps them unique
+  Array doc;
+  initArray(&doc, 1024);
+  doc.site = w->site;
+  ByteArray *mine = malloc(w->ops * sizeof(ByteArray));
+  size_t n = 0;
+  uint32_t x = w->site * 2654435761u + 1;
+  for (int i = 0; i < w->ops; ++i){
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    if (n > 0 && x % 4 == 0){
+      size_t k = (x >> 8) % n;
+      assert(removeLfSkipList(&h, mine[k]));
+      assert(!containsLfSkipList(&h, mine[k]));
+      free(mine[k].data);
+      mine[k] = mine[--n];
+    }
+    else{
+      int pos = (x >> 8) % (doc.used+1);
+      insertArrayAt(&doc, pos);
+      ByteArray view = InlineId_View(&doc.ba[pos]);
+      mine[n].len = view.len;
+      mine[n].data = malloc(view.len);
+      memcpy(mine[n].data, view.data, view.len);
+      assert(insertLfSkipList(&h, mine[n]));
+      assert(!insertLfSkipList(&h, mine[n]));
+      n++;
+    }
+  }
+  for (size_t k = 0; k < n; ++k){
+    assert(containsLfSkipList(&h, mine[k]));
+    free(mine[k].data);
+  }
+  w->live = n;
+  free(mine);
+  freeDocument(&doc);
+  atomic_fetch_add(w->done, 1);
+  return NULL;
+}
+
+void *lfReader(void *arg){
+  LfWorker *w = arg;
+  LfHandle h;
+  initLfHandle(&h, w->list, 7);
+  // in-order walks keep seeing a strictly increasing sequence
+  while (atomic_load(w->done) < w->ops){
+    SkipCheck c = {{0, NULL}, 0};
+    forEachLfSkipList(&h, checkSkipOrder, &c);
+  }
+  return NULL;
+}
+
+void testLockFreeSkipList(){
+  enum { WRITERS = 8 };
+  LfSkipList l;
+  initLfSkipList(&l);
+  atomic_int done;
+  atomic_init(&done, 0);
+  pthread_t tid[WRITERS+1];
+  LfWorker w[WRITERS+1];
+  for (int i = 0; i < WRITERS; ++i){
+    w[i] = (LfWorker){&l, i, 20000, 0, &done};
+    pthread_create(&tid[i], NULL, lfWriter, &w[i]);
+  }
+  w[WRITERS] = (LfWorker){&l, 0, WRITERS, 0, &done};
+  pthread_create(&tid[WRITERS], NULL, lfReader, &w[WRITERS]);
+  size_t live = 0;
+  for (int i = 0; i <= WRITERS; ++i){
+    pthread_join(tid[i], NULL);
+    live += w[i].live;
+  }
+  LfHandle h;
+  initLfHandle(&h, &l, 1);
+  SkipCheck c = {{0, NULL}, 0};
+  forEachLfSkipList(&h, checkSkipOrder, &c);
+  assert(c.count == live && live == atomic_load(&l.used));
+  printf("%zu ids left after %d writers\n", live, WRITERS);
+  freeLfSkipList(&l);
+}
+
+void testMergeBatch(){
+  Array local, remote;
+  Tree tree;
+  initArray(&local, 1024);
+  initArray(&remote, 1024);
+  initTree(&tree);
+  local.site = tree.site = 1;
+  remote.site = 2;
+  for (int i = 0; i < 5000; ++i){
+    int pos = rand() % (local.used+1);
+    insertArrayAt(&local, pos);
+    insertTreeAt(&tree, pos);
+    insertArrayAt(&remote, rand() % (remote.used+1));
+  }
+  // the batch repeats some ids of its own and some already known locally
+  size_t k = 0;
+  ByteArray *batch = malloc(3 * remote.used * sizeof(ByteArray));
+  for (int i = 0; i < remote.used; ++i){
+    batch[k++] = InlineId_View(&remote.ba[i]);
+    if (i % 7 == 0)
+      batch[k++] = InlineId_View(&remote.ba[i]);
+    if (i % 5 == 0)
+      batch[k++] = InlineId_View(getTreeAt(&tree, rand() % tree.used));
+  }
+  qsort(batch, k, sizeof(ByteArray), ByteArray_CompareCompressedPtr);
+  size_t before = local.used;
+  assert(mergeArray(&local, batch, k) == remote.used);
+  assert(mergeTree(&tree, batch, k) == remote.used);
+  assert(local.used == before + remote.used && tree.used == local.used);
+  for (int i = 0; i < local.used; ++i){
+    assert(i == 0 || InlineId_Compare(&local.ba[i-1], &local.ba[i]) < 0);
+    assert(InlineId_Compare(&local.ba[i], getTreeAt(&tree, i)) == 0);
+  }
+  assert(mergeArray(&local, batch, k) == 0);
+  free(batch);
+  freeDocument(&local);
+  freeDocument(&remote);
+  freeTree(&tree);
+}
+
+void testSerialize(){
+  Array a, b;
+  initArray(&a, 1024);
+  initArray(&b, 16);
+  for (int i = 0; i < 100000; ++i)
+    insertArrayAt(&a, rand() % (a.used+1));
+  FILE *f = tmpfile();
+  assert(saveArray(&a, f) == 0);
+  long bytes = ftell(f);
+  rewind(f);
+  assert(loadArray(&b, f) == a.used);
+  assert(b.used == a.used);
+  size_t raw = 0;
+  for (int i = 0; i < a.used; ++i){
+    assert(InlineId_Compare(&a.ba[i], &b.ba[i]) == 0);
+    raw += a.ba[i].len;
+  }
+  printf("%zu ids: %ld bytes on disk, %zu bytes of ids\n", a.used, bytes, raw);
+  // a truncated stream is refused
+  FILE *g = tmpfile();
+  rewind(f);
+  for (long i = 0; i < bytes-3; ++i)
+    putc(getc(f), g);
+  rewind(g);
+  assert(loadArray(&b, g) == -1);
+  // so is a corrupt length, without trying to allocate it
+  FILE *h = tmpfile();
+  uint8_t huge[16];
+  size_t n = putVarint(huge, 0);
+  n += putVarint(huge+n, (size_t)1 << 62);
+  fwrite(SERIAL_MAGIC, 1, 4, h);
+  fwrite(huge, 1, n, h);
+  rewind(h);
+  assert(loadArray(&b, h) == -1);
+  fclose(f);
+  fclose(g);
+  fclose(h);
+  freeDocument(&a);
+  freeDocument(&b);
+}
+
+void testSnapshot(){
+  Array a;
+  initArray(&a, 1024);
+  for (int i = 0; i < 100000; ++i)
+    insertArrayAt(&a, rand() % (a.used+1));
+  char path[] = "/tmp/id-gen-snapshotXXXXXX";
+  close(mkstemp(path));
+  assert(writeSnapshot(&a, path) == 0);
+  Snapshot s;
+  assert(openSnapshot(&s, path) == 0);
+  assert(s.count == a.used);
+  IdScratch scratch;
+  initScratch(&scratch);
+  for (int i = 0; i < a.used; ++i){
+    ByteArray id = InlineId_View(&a.ba[i]);
+    assert(ByteArray_CompareCompressed(snapshotId(&s, i), id) == 0);
+    assert(indexOfSnapshot(&s, id) == i);
+    ByteArray g = GenerateSnapshotIdViewAt(&s, &scratch, i, STRATEGY_BISECT, SITE_NONE);
+    assert(indexOfSnapshot(&s, g) == -1 && lowerBoundSnapshot(&s, g) == i);
+  }
+  freeScratch(&scratch);
+  closeSnapshot(&s);
+  // an empty id, two equal offsets, is refused
+  FILE *f = fopen(path, "r+b");
+  uint64_t bad;
+  fseek(f, sizeof(SnapshotHeader) + 4 * sizeof(uint64_t), SEEK_SET);
+  assert(fread(&bad, sizeof(bad), 1, f) == 1);
+  fseek(f, sizeof(SnapshotHeader) + 5 * sizeof(uint64_t), SEEK_SET);
+  fwrite(&bad, sizeof(bad), 1, f);
+  fclose(f);
+  assert(openSnapshot(&s, path) == -1);
+  // so is an offset pointing outside the file
+  f = fopen(path, "r+b");
+  bad = UINT64_MAX;
+  fseek(f, sizeof(SnapshotHeader) + 5 * sizeof(uint64_t), SEEK_SET);
+  fwrite(&bad, sizeof(bad), 1, f);
+  fclose(f);
+  assert(openSnapshot(&s, path) == -1);
+  // a cut file is refused
+  assert(truncate(path, 40) == 0);
+  assert(openSnapshot(&s, path) == -1);
+  unlink(path);
+  freeDocument(&a);
+}
+
+// Writes an editing session: typing bursts, backspaces, forward deletes
+// and scattered single ops.
+size_t writeEditLog(FILE *f, size_t ops){
+  size_t used = 0, written = 0;
+  while (written < ops){
+    size_t pos = rand() % (used+1);
+    size_t burst = rand() % 32 + 1;
+    burst = MIN(burst, ops - written);
+    int kind = used == 0 ? 0 : rand() % 4;
+    for (size_t i = 0; i < burst; ++i, ++written){
+      if (kind <= 1 || used == 0){ // typing
+        if (pos > used)
+          pos = used;
+        putOp(f, 0, pos++);
+        used++;
+      }
+      else if (kind == 2){ // backspace
+        size_t p = pos >= used ? used-1 : pos;
+        pos = p > 0 ? p-1 : 0;
+        putOp(f, 1, p);
+        used--;
+      }
+      else{ // forward delete
+        if (pos >= used)
+          pos = used-1;
+        putOp(f, 1, pos);
+        used--;
+      }
+    }
+  }
+  return used;
+}
+
+void testReplay(){
+  FILE *f = tmpfile();
+  size_t used = writeEditLog(f, 200000);
+  rewind(f);
+  Array batched, single;
+  initArray(&batched, 16);
+  initArray(&single, 16);
+  ReplayStats stats;
+  assert(replayOpLog(&batched, f, &stats) == 200000);
+  printReplayStats(&stats);
+  assert(batched.used == used);
+  for (int i = 1; i < batched.used; ++i)
+    assert(InlineId_Compare(&batched.ba[i-1], &batched.ba[i]) < 0);
+  // the same log op by op gives a sequence of the same length
+  rewind(f);
+  size_t v;
+  while (readVarint(f, &v) == 0)
+    if (v & 1)
+      deleteArrayRange(&single, v >> 1, 1);
+    else
+      insertArrayAt(&single, v >> 1);
+  assert(single.used == used);
+  // out of bounds ops are refused
+  rewind(f);
+  putOp(f, 1, used + 5);
+  rewind(f);
+  Array bad;
+  initArray(&bad, 16);
+  assert(replayOpLog(&bad, f, NULL) == -1);
+  fclose(f);
+  // so are logs that cannot be read: a directory opens but fails to read
+  f = fopen("/", "r");
+  assert(f != NULL && replayOpLog(&bad, f, NULL) == -1);
+  fclose(f);
+  freeDocument(&batched);
+  freeDocument(&single);
+  freeDocument(&bad);
+}
+
+void testTaggedIds(){
+  size_t n = 0, cap = 1024;
+  TaggedId *seq = malloc(cap * sizeof(TaggedId));
+  TaggedId bottom = TaggedId_FromRaw(&BottomByte, 1);
+  uint8_t x[64], y[64];
+  for (int i = 0; i < 20000; ++i){
+    size_t pos = i < 500 ? n : rand() % (n+1); // appends first, then random
+    if (n == cap)
+      seq = realloc(seq, (cap *= 2) * sizeof(TaggedId));
+    TaggedId id = TaggedId_GenerateBetween(pos > 0 ? seq[pos-1] : bottom, pos < n ? seq[pos] : TAGGED_TOP);
+    memmove(seq+pos+1, seq+pos, (n-pos) * sizeof(TaggedId));
+    seq[pos] = id;
+    n++;
+  }
+  size_t packed = 0;
+  for (size_t i = 0; i < n; ++i){
+    packed += TaggedId_IsPacked(seq[i]);
+    size_t len = TaggedId_ToRaw(seq[i], x);
+    assert(x[len-1] != 0x00);
+    if (i > 0){
+      assert(TaggedId_Compare(seq[i-1], seq[i]) < 0);
+      ByteArray a = {TaggedId_ToRaw(seq[i-1], y), y}, b = {len, x};
+      assert(compare(a, b) < 0);
+    }
+  }
+  // packing round-trips
+  for (size_t i = 0; i < n; ++i){
+    size_t len = TaggedId_ToRaw(seq[i], x);
+    TaggedId t = TaggedId_FromRaw(x, len);
+    assert(TaggedId_Compare(t, seq[i]) == 0);
+    TaggedId_Free(t);
+  }
+  printf("%zu of %zu ids packed\n", packed, n);
+  for (size_t i = 0; i < n; ++i)
+    TaggedId_Free(seq[i]);
+  free(seq);
+}
+
+void testCodec(){
+  uint8_t raw[40000];
+  for (int round = 0; round < 2000; ++round){
+    // digits with runs of 0x7f up to three count digits long, every other
+    // one short enough for the one-pass path
+    size_t len = 0, target = round % 2 ? 60 : rand() % 12;
+    while (len < target){
+      if (rand() % 3 == 0){
+        size_t run = round % 100 == 0 ? 20000 + rand() % 10000 : rand() % 300 + 1;
+        memset(raw+len, N127, run);
+        len += run;
+      }
+      else
+        raw[len++] = rand() % N127;
+    }
+    raw[len++] = 0x01;
+    ByteArray ba = {len, raw};
+    ByteArray comp = compress(ba), back = decompress(comp);
+    assert(comp.len == compressedLen(raw, len) && comp.len <= len);
+    assert(back.len == len && memcmp(back.data, raw, len) == 0);
+    if (round % 100 != 0){ // the legacy codec agrees below 16384 bytes per run
+      ByteArray legacy = compressLegacy(ba), legacyBack = decompressLegacy(comp);
+      assert(legacy.len == comp.len && memcmp(legacy.data, comp.data, comp.len) == 0);
+      assert(legacyBack.len == len && memcmp(legacyBack.data, raw, len) == 0);
+      free(legacy.data);
+      free(legacyBack.data);
+    }
+    free(comp.data);
+    free(back.data);
+  }
+}
+
+// A chain of versions, each a snapshot of the previous one plus a few
+// edits, mirrored by a growable array. Every version must still read back
+// exactly as it was when it was forked, and releasing them in any order
+// frees everything.
+void testPersistentTree(){
+  enum { VERSIONS = 200, EDITS = 10, BASE = 5000 };
+  PTree v[VERSIONS];
+  InlineId *frozen[VERSIONS];
+  size_t frozenLen[VERSIONS];
+  Array mirror;
+  initArray(&mirror, 16);
+  initPTree(&v[0]);
+  for (int i = 0; i < BASE; ++i){
+    int pos = rand() % (mirror.used+1);
+    insertArrayAt(&mirror, pos);
+    insertPTreeAt(&v[0], pos);
+  }
+  for (int k = 0; k < VERSIONS; ++k){
+    if (k > 0){
+      snapshotPTree(&v[k], &v[k-1]);
+      for (int e = 0; e < EDITS; ++e){
+        if (rand() % 3 == 0){
+          int pos = rand() % mirror.used;
+          deleteArrayRange(&mirror, pos, 1);
+          deletePTreeAt(&v[k], pos);
+        }
+        else{
+          int pos = rand() % (mirror.used+1);
+          insertArrayAt(&mirror, pos);
+          insertPTreeAt(&v[k], pos);
+        }
+      }
+    }
+    assert(v[k].used == mirror.used);
+    frozenLen[k] = mirror.used;
+    frozen[k] = malloc(mirror.used * sizeof(InlineId));
+    for (size_t i = 0; i < mirror.used; ++i){
+      assert(InlineId_Compare(&mirror.ba[i], getPTreeAt(&v[k], i)) == 0);
+      frozen[k][i] = InlineId_FromByteArray(NULL, InlineId_View(&mirror.ba[i]));
+    }
+  }
+  for (int k = 0; k < VERSIONS; ++k){
+    assert(v[k].used == frozenLen[k]);
+    for (size_t i = 0; i < frozenLen[k]; ++i)
+      assert(InlineId_Compare(&frozen[k][i], getPTreeAt(&v[k], i)) == 0);
+  }
+  printf("%d versions of a %d id document intact\n", VERSIONS, BASE);
+  for (int k = 0; k < VERSIONS; ++k){
+    for (size_t i = 0; i < frozenLen[k]; ++i)
+      InlineId_Free(NULL, &frozen[k][i]);
+    free(frozen[k]);
+  }
+  for (int k = 0; k < VERSIONS; ++k){
+    int j = rand() % (VERSIONS-k) + k; // release in random order
+    PTree tmp = v[k];
+    v[k] = v[j];
+    v[j] = tmp;
+    freePTree(&v[k]);
+  }
+  freeDocument(&mirror);
+}
+
 ///// end of unit tests
 
+#ifdef IDGEN_BENCH
+
+///// benchmarks
+
+// Built by `make bench`. For every workload and document size it times the
+// id primitives and the Array, GapBuffer and ChunkList operations. Each
+// (operation, workload) pair goes to bench_<op>_<workload>.csv as
+// `Size,<workload>,allocs` rows (ns/op, allocations/op), ready for
+//   gnuplot -e "inputfiles='bench_insert_random.csv bench_insert_append.csv'; outputname='insert.pdf'" histo.gnuplot
+// and every measurement is also echoed on stdout.
+
+typedef enum {
+  WORKLOAD_RANDOM,
+  WORKLOAD_APPEND,
+  WORKLOAD_PREPEND,
+  WORKLOAD_PASTE, /**< Bursts of up to 64 consecutive positions. */
+  WORKLOAD_ZIPF, /**< Positions with density ~ 1/rank from the start. */
+  WORKLOAD_LOCAL, /**< Nine in ten positions within 4 of the previous one. */
+  WORKLOADS
+} Workload;
+
+static const char *WorkloadNames[WORKLOADS] = {"random", "append", "prepend", "paste", "zipf", "local"};
+
+typedef struct {
+  Workload w;
+  int pos; /**< Position of the current paste burst, or of the last local edit. */
+  int left; /**< Elements left in the current paste burst. */
+} PositionGen;
+
+// Next position for a sequence of `used` elements; `inserting` allows the
+// position one past the end.
+int nextPosition(PositionGen *g, size_t used, int inserting){
+  size_t n = used + (inserting ? 1 : 0);
+  switch (g->w){
+  case WORKLOAD_APPEND:
+    return n-1;
+  case WORKLOAD_PREPEND:
+    return 0;
+  case WORKLOAD_PASTE:
+    if (g->left == 0 || g->pos >= n){
+      g->pos = rand() % n;
+      g->left = rand() % 64 + 1;
+    }
+    g->left--;
+    // pasting moves right, deleting a block keeps hitting the same spot
+    return inserting ? g->pos++ : g->pos;
+  case WORKLOAD_LOCAL:
+    if (g->pos >= n || rand() % 10 == 0)
+      g->pos = rand() % n;
+    else{
+      int near = g->pos + rand() % 9 - 4;
+      g->pos = MAX(0, MIN(near, (int)n-1));
+    }
+    return g->pos;
+  case WORKLOAD_ZIPF:
+  {
+    size_t rank = (size_t)pow((double)n+1, (double)rand() / RAND_MAX);
+    return MIN(rank, n) - 1;
+  }
+  default:
+    return rand() % n;
+  }
+}
+
+double nowNs(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+enum { OP_INSERT, OP_GENERATE, OP_COMPRESS, OP_DECOMPRESS, OP_COMPRESS_LEGACY, OP_DECOMPRESS_LEGACY, OP_COMPARE, OP_DELETE, OP_GAP_INSERT, OP_GAP_DELETE, OP_CHUNK_INSERT, OP_CHUNK_DELETE, OPS };
+static const char *OpNames[OPS] = {"insert", "generate", "compress", "decompress", "compress_legacy", "decompress_legacy", "compare", "delete", "gap_insert", "gap_delete", "chunk_insert", "chunk_delete"};
+static FILE *BenchFiles[OPS][WORKLOADS];
+
+void openBenchFiles(){
+  char name[64];
+  for (int op = 0; op < OPS; ++op)
+    for (int w = 0; w < WORKLOADS; ++w){
+      snprintf(name, sizeof(name), "bench_%s_%s.csv", OpNames[op], WorkloadNames[w]);
+      BenchFiles[op][w] = fopen(name, "w");
+      if (BenchFiles[op][w] == NULL){
+        printf("Error opening file!\n");
+        exit(1);
+      }
+      fprintf(BenchFiles[op][w], "%s,%s,%s\n", "Size", WorkloadNames[w], "allocs");
+    }
+}
+
+void report(int op, Workload w, size_t size, size_t ops, double ns, size_t allocs){
+  double nsPerOp = ns / ops, allocsPerOp = (double)allocs / ops;
+  fprintf(BenchFiles[op][w], "%zu,%.1f,%.3f\n", size, nsPerOp, allocsPerOp);
+  printf("%s,%s,%zu,%.1f,%.3f\n", OpNames[op], WorkloadNames[w], size, nsPerOp, allocsPerOp);
+  fflush(stdout);
+}
+
+void benchWorkload(Workload w, size_t size){
+  Array a;
+  initArray(&a, size);
+  insertArrayAtN(&a, 0, size);
+  PositionGen g = {w, 0, 0};
+  // shifting costs O(size) per op, so big documents get fewer ops
+  size_t ops = MIN(size, 100000);
+  size_t shiftOps = MAX(64, MIN(ops, (size_t)2e9 / (size * sizeof(InlineId))));
+  size_t allocs;
+  double t;
+
+  // the same edits on a gap buffer holding the same document
+  GapBuffer gb;
+  initGapBufferFromArray(&gb, &a);
+  PositionGen gapg = {w, 0, 0};
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < shiftOps; ++i)
+    insertGapBufferAt(&gb, nextPosition(&gapg, gb.used, 1));
+  report(OP_GAP_INSERT, w, size, shiftOps, nowNs() - t, benchAllocs - allocs);
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < shiftOps; ++i)
+    deleteGapBufferAt(&gb, nextPosition(&gapg, gb.used, 0));
+  report(OP_GAP_DELETE, w, size, shiftOps, nowNs() - t, benchAllocs - allocs);
+  freeGapBuffer(&gb);
+
+  // and on an unrolled list: edits move at most a chunk, but finding a
+  // far position walks the chunks
+  ChunkList cl;
+  initChunkListFromArray(&cl, &a);
+  PositionGen chunkg = {w, 0, 0};
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < shiftOps; ++i)
+    insertChunkListAt(&cl, nextPosition(&chunkg, cl.used, 1));
+  report(OP_CHUNK_INSERT, w, size, shiftOps, nowNs() - t, benchAllocs - allocs);
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < shiftOps; ++i)
+    deleteChunkListAt(&cl, nextPosition(&chunkg, cl.used, 0));
+  report(OP_CHUNK_DELETE, w, size, shiftOps, nowNs() - t, benchAllocs - allocs);
+  freeChunkList(&cl);
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < shiftOps; ++i)
+    insertArrayAt(&a, nextPosition(&g, a.used, 1));
+  report(OP_INSERT, w, size, shiftOps, nowNs() - t, benchAllocs - allocs);
+
+  // neighbour pairs and their decompressed forms, picked by the workload
+  ByteArray *left = malloc(ops * sizeof(ByteArray));
+  ByteArray *right = malloc(ops * sizeof(ByteArray));
+  ByteArray *raw = malloc(2 * ops * sizeof(ByteArray));
+  ByteArray *out = malloc(ops * sizeof(ByteArray));
+  for (size_t i = 0; i < ops; ++i){
+    int pos = nextPosition(&g, a.used, 0);
+    pos = MAX(pos, 1);
+    left[i] = InlineId_View(&a.ba[pos-1]);
+    right[i] = InlineId_View(&a.ba[pos]);
+    raw[2*i] = decompress(left[i]);
+    raw[2*i+1] = decompress(right[i]);
+  }
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < ops; ++i)
+    out[i] = ByteArray_GenerateBetween(left[i], right[i], Compression);
+  report(OP_GENERATE, w, size, ops, nowNs() - t, benchAllocs - allocs);
+  for (size_t i = 0; i < ops; ++i)
+    free(out[i].data);
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < ops; ++i)
+    out[i] = compress(raw[2*i]);
+  report(OP_COMPRESS, w, size, ops, nowNs() - t, benchAllocs - allocs);
+  for (size_t i = 0; i < ops; ++i)
+    free(out[i].data);
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < ops; ++i)
+    out[i] = decompress(left[i]);
+  report(OP_DECOMPRESS, w, size, ops, nowNs() - t, benchAllocs - allocs);
+  for (size_t i = 0; i < ops; ++i)
+    free(out[i].data);
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < ops; ++i)
+    out[i] = compressLegacy(raw[2*i]);
+  report(OP_COMPRESS_LEGACY, w, size, ops, nowNs() - t, benchAllocs - allocs);
+  for (size_t i = 0; i < ops; ++i)
+    free(out[i].data);
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < ops; ++i)
+    out[i] = decompressLegacy(left[i]);
+  report(OP_DECOMPRESS_LEGACY, w, size, ops, nowNs() - t, benchAllocs - allocs);
+  for (size_t i = 0; i < ops; ++i)
+    free(out[i].data);
+
+  volatile int sink = 0;
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < ops; ++i)
+    sink += compare(raw[2*i], raw[2*i+1]);
+  report(OP_COMPARE, w, size, ops, nowNs() - t, benchAllocs - allocs);
+
+  for (size_t i = 0; i < 2*ops; ++i)
+    free(raw[i].data);
+  free(left);
+  free(right);
+  free(raw);
+  free(out);
+
+  allocs = benchAllocs;
+  t = nowNs();
+  for (size_t i = 0; i < shiftOps; ++i)
+    deleteArrayAt(&a, nextPosition(&g, a.used, 0));
+  report(OP_DELETE, w, size, shiftOps, nowNs() - t, benchAllocs - allocs);
+
+  freeDocument(&a);
+}
+
+int main(int argc, char **argv) {
+  size_t maxSize = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+  srand(42);
+  openBenchFiles();
+  printf("op,workload,size,ns_per_op,allocs_per_op\n");
+  for (size_t size = 1000; size <= maxSize; size *= 10)
+    for (int w = 0; w < WORKLOADS; ++w)
+      benchWorkload(w, size);
+  for (int op = 0; op < OPS; ++op)
+    for (int w = 0; w < WORKLOADS; ++w)
+      fclose(BenchFiles[op][w]);
+  return 0;
+}
+
+///// end of benchmarks
+
+#else
+
 int main(int argc, char **argv) {
   // testCompress();
   // testDecompress();
   // testGenerateBetween();
+  // testCompareCompressed();
+  // testCompareFast();
+  // testInlineIds();
+  // testTreeMatchesArray();
+  // testArenaSequences();
+  // testGapBufferMatchesArray();
+  // testLazyArrayMatchesArray();
+  // testPositionIndex();
+  // testChunkListMatchesArray();
+  // testParallelImport();
+  // testIdIndex();
+  // testGenerateNBetween();
+  // testStrategies();
+  // testSiteIds();
+  // testConcurrentSkipList();
+  // testLockFreeSkipList();
+  // testMergeBatch();
+  // testSerialize();
+  // testSnapshot();
+  // testReplay();
+  // testTaggedIds();
+  // testCodec();
+  // testPersistentTree();
   // srand((unsigned int)time(NULL));
   // rand();
   // randomInsertTest(1000);
@@ -457,5 +5684,14 @@ int main(int argc, char **argv) {
 
   fclose(f);
 
+#ifdef IDGEN_STATS
+  srand(42);
+  runStatsWorkload(100000);
+  printIdStats();
+  dumpIdStats("stats");
+#endif
+
   return 0;
-}
\ No newline at end of file
+}
+
+#endif